@@ -90,6 +90,10 @@ typedef struct ac_pattern
     AC_TEXT_t ptext;    /**< The search string */
     AC_TEXT_t rtext;    /**< The replace string */
     AC_PATTID_t id;   /**< Pattern identifier */
+    struct ac_pattern *merged;  /**< The next pattern with the same string 
+                                 * and another identifier, if the trie merges 
+                                 * the duplicates; NULL otherwise. It is set 
+                                 * by the trie */
 } AC_PATTERN_t;
 
 /**
@@ -101,6 +105,8 @@ typedef struct ac_pattern
  * matched patterns have same end-position in the text. There is a relationship
  * between matched patterns: the shorter one is a factor (tail) of the longer
  * one. The 'position' maintains the end position of matched patterns.
+ * The trie which merges the duplicates has one pattern for each string; the 
+ * other patterns of the string are linked by its 'merged' field.
  */
 typedef struct ac_match
 {
@@ -141,20 +147,62 @@ typedef int (*AC_MATCH_CALBACK_f)(AC_MATCH_t *, void *);
  */
 typedef void (*MF_REPLACE_CALBACK_f)(AC_TEXT_t *, void *);
 
+/**
+ * A segment of the replacement result. It points directly to the input text,
+ * the backlog or a replacement text, so no copy is made.
+ */
+typedef struct mf_segment
+{
+    AC_TEXT_t text;     /**< The segment string */
+    size_t position;    /**< Position of the segment in the whole input, or
+                         * MF_SEGMENT_NOT_INPUT for a replacement text */
+} MF_SEGMENT_t;
+
+#define MF_SEGMENT_NOT_INPUT ((size_t)-1)
+
+/**
+ * @brief Call-back function to receive the replacement result as an array of
+ * segments. The segments are valid only until the call-back returns.
+ */
+typedef void (*MF_REPLACE_SEGMENT_CALBACK_f)(MF_SEGMENT_t *, size_t, void *);
+
+/**
+ * @brief Call-back function to produce the replacement of a pattern 
+ * occurrence. It receives the pattern, the start position of the occurrence 
+ * in the whole input and a buffer of the given size (at least 
+ * AC_PATTRN_MAX_LENGTH); it writes the replacement into the buffer and 
+ * returns its length.
+ */
+typedef size_t (*MF_REPLACE_PATTERN_CALBACK_f)
+    (AC_PATTERN_t *, size_t, AC_ALPHABET_t *, size_t, void *);
+
+/**
+ * @brief Call-back function to receive the number of replacements of a 
+ * pattern in a dry-run; see multifast_rep_stats()
+ */
+typedef void (*MF_REPLACE_COUNT_CALBACK_f)(AC_PATTERN_t *, size_t, void *);
+
 /**
  * Maximum accepted length of search/replace pattern
  */
 #define AC_PATTRN_MAX_LENGTH 1024
 
 /**
- * Replacement buffer size 
+ * Default replacement buffer size; it can be changed for every trie using 
+ * multifast_rep_set_bufsize()
  */
-#define MF_REPLACEMENT_BUFFER_SIZE 2048
+#define MF_REPLACEMENT_BUFFER_SIZE 65536
 
 #if (MF_REPLACEMENT_BUFFER_SIZE <= AC_PATTRN_MAX_LENGTH)
 #error "REPLACEMENT_BUFFER_SIZE must be bigger than AC_PATTRN_MAX_LENGTH"
 #endif
 
+/**
+ * Approximate size of the regions that multifast_replace_parallel() gives 
+ * to every thread
+ */
+#define MF_PARALLEL_REGION_SIZE (4*1024*1024)
+
 typedef enum act_working_mode
 {
     AC_WORKING_MODE_SEARCH = 0, /* Default */
@@ -162,6 +210,21 @@ typedef enum act_working_mode
     AC_WORKING_MODE_REPLACE     /* Not used */
 } ACT_WORKING_MODE_t;
 
+/**
+ * Which matches are reported by the search
+ */
+typedef enum ac_match_mode
+{
+    AC_MATCH_MODE_ALL = 0,  /**< Every match, even the overlapping ones */
+    AC_MATCH_MODE_LEFTMOST_LONGEST, /**< Non-overlapping matches; among the 
+                                     * matches that start first the longest 
+                                     * one is reported */
+    AC_MATCH_MODE_LEFTMOST_FIRST    /**< Non-overlapping matches; among the 
+                                     * matches that start first the one which
+                                     * was added to the trie first is 
+                                     * reported */
+} AC_MATCH_MODE_t;
+
 
 #ifdef __cplusplus
 }
@@ -25,6 +25,7 @@
 #include "node.h"
 #include "ahocorasick.h"
 #include "mpool.h"
+#include "parallel.h"
 
 /* Privates */
 
@@ -37,12 +38,26 @@ static void ac_trie_traverse_setfailure
 static void ac_trie_traverse_action 
     (ACT_NODE_t *node, void(*func)(ACT_NODE_t *), int top_down);
 
+static void ac_trie_traverse_bfs 
+    (AC_TRIE_t *thiz, void(*func)(ACT_NODE_t *));
+
+static void ac_trie_setfailure_job (size_t job, void *param);
+
 static void ac_trie_reset 
     (AC_TRIE_t *thiz);
 
 static int ac_trie_match_handler 
     (AC_MATCH_t * matchp, void * param);
 
+static int ac_trie_search_leftmost (AC_TRIE_t *thiz, AC_TEXT_t *text, 
+        int flush, AC_MATCH_CALBACK_f callback, void *user);
+
+static void ac_trie_leftmost_candidate 
+    (AC_TRIE_t *thiz, ACT_NODE_t *node, size_t position);
+
+static void ac_trie_leftmost_savetail 
+    (AC_TRIE_t *thiz, AC_TEXT_t *text, size_t length);
+
 /* Friends */
 
 extern void mf_repdata_init (AC_TRIE_t *thiz);
@@ -60,10 +75,26 @@ AC_TRIE_t *ac_trie_create (void)
 {
     AC_TRIE_t *thiz = (AC_TRIE_t *) malloc (sizeof(AC_TRIE_t));
     thiz->mp = mpool_create(0);
+    thiz->cold_mp = mpool_create(0);
+    
+    thiz->patterns_count = 0;
+    thiz->merged_count = 0;
+    thiz->nodes_count = 0;
+    thiz->edges_count = 0;
+    thiz->next_order = 0;
+    thiz->build_threads = 1;
+    thiz->merge_duplicates = 0;
+    thiz->shared = 0;
+    
+    thiz->edges_ordered = 1;
+    thiz->sorted_path = NULL;
+    thiz->sorted_prefix = NULL;
+    thiz->sorted_depth = 0;
     
     thiz->root = node_create (thiz);
     
-    thiz->patterns_count = 0;
+    thiz->match_mode = AC_MATCH_MODE_ALL;
+    thiz->leftmost.tail = NULL;
     
     mf_repdata_init (thiz);
     ac_trie_reset (thiz);    
@@ -86,6 +117,12 @@ AC_TRIE_t *ac_trie_create (void)
  * the pattern are available in the user program then call the function with 
  * copy = 0 and do not waste memory.
  * 
+ * A pattern whose string is already in the trie is a duplicate; it is 
+ * rejected, unless trie->merge_duplicates is set. Then it is linked to the 
+ * first pattern of the string by the 'merged' field, and the matches of the 
+ * string report all of its identifiers. The identifiers are not compared; 
+ * the caller should not add the same pattern twice.
+ * 
  * @return The return value indicates the success or failure of adding action
  *****************************************************************************/
 AC_STATUS_t ac_trie_add (AC_TRIE_t *thiz, AC_PATTERN_t *patt, int copy)
@@ -121,9 +158,19 @@ AC_STATUS_t ac_trie_add (AC_TRIE_t *thiz, AC_PATTERN_t *patt, int copy)
     }
     
     if(n->final)
-        return ACERR_DUPLICATE_PATTERN;
+    {
+        /* The first pattern keeps the order and the replacement */
+        if (!thiz->merge_duplicates)
+            return ACERR_DUPLICATE_PATTERN;
+        
+        node_merge_pattern (n, patt, copy);
+        thiz->patterns_count++;
+        thiz->merged_count++;
+        return ACERR_SUCCESS;
+    }
     
     n->final = 1;
+    n->cold->order = thiz->next_order++;
     node_accept_pattern (n, patt, copy);
     thiz->patterns_count++;
     
@@ -134,9 +181,13 @@ AC_STATUS_t ac_trie_add (AC_TRIE_t *thiz, AC_PATTERN_t *patt, int copy)
  * @brief Finalizes the preprocessing stage and gets the trie ready
  * 
  * Locates the failure node for all nodes and collects all matched 
- * pattern for each node. It also sorts outgoing edges of node, so binary 
- * search could be performed on them. After calling this function the automate 
- * will be finalized and you can not add new patterns to the automate.
+ * pattern for each node. It also sorts and indexes outgoing edges of node, 
+ * so the search loop can look them up quickly. After calling this function 
+ * the automate will be finalized and you can not add new patterns to the 
+ * automate.
+ * 
+ * If trie->build_threads is more than 1, the failure nodes of the root 
+ * subtrees are located in parallel.
  * 
  * @param thiz pointer to the trie
  *****************************************************************************/
@@ -144,16 +195,75 @@ void ac_trie_finalize (AC_TRIE_t *thiz)
 {
     AC_ALPHABET_t prefix[AC_PATTRN_MAX_LENGTH]; 
     
-    /* 'prefix' defined here, because ac_trie_traverse_setfailure() calls
-     * itself recursively */
-    ac_trie_traverse_setfailure (thiz->root, prefix);
+    if (thiz->build_threads > 1)
+    {
+        /* The failure node of a node only depends on the trie structure, 
+         * so every subtree of the root can be processed separately */
+        ac_parallel_run (thiz->build_threads, thiz->root->outgoing_size, 
+                ac_trie_setfailure_job, thiz->root);
+    }
+    else
+    {
+        /* 'prefix' defined here, because ac_trie_traverse_setfailure() 
+         * calls itself recursively */
+        ac_trie_traverse_setfailure (thiz->root, prefix);
+    }
     
-    ac_trie_traverse_action (thiz->root, node_collect_matches, 1);
+    ac_trie_traverse_bfs (thiz, node_collect_matches);
+    ac_trie_traverse_action (thiz->root, node_index_edges, 1);
     mf_repdata_allocbuf (&thiz->repdata);
     
+    /* The path of ac_trie_add_sorted() is not needed any more */
+    free (thiz->sorted_path);
+    free (thiz->sorted_prefix);
+    thiz->sorted_path = NULL;
+    thiz->sorted_prefix = NULL;
+    
     thiz->trie_open = 0; /* Do not accept patterns any more */
 }
 
+/**
+ * @brief Makes a clone of a finalized trie. The clone shares the nodes with 
+ * the original trie, but has its own search and replace state; so different 
+ * threads can search or replace using different clones at the same time.
+ * 
+ * The clone must be released by ac_trie_release() before the original trie.
+ * 
+ * @param thiz pointer to the finalized trie
+ * @return The clone, or NULL if the trie is not finalized
+ *****************************************************************************/
+AC_TRIE_t *ac_trie_clone (AC_TRIE_t *thiz)
+{
+    AC_TRIE_t *clone;
+    
+    if (thiz->trie_open)
+        return NULL;
+    
+    clone = (AC_TRIE_t *) malloc (sizeof(AC_TRIE_t));
+    memcpy (clone, thiz, sizeof(AC_TRIE_t));
+    
+    clone->shared = 1;
+    clone->sorted_path = NULL;
+    clone->sorted_prefix = NULL;
+    clone->leftmost.tail = NULL;
+    
+    mf_repdata_init (clone);
+    clone->repdata.buffer_size = thiz->repdata.buffer_size;
+    clone->repdata.has_replacement = thiz->repdata.has_replacement;
+    clone->repdata.same_length = thiz->repdata.same_length;
+    clone->repdata.pcbf = thiz->repdata.pcbf;
+    clone->repdata.puser = thiz->repdata.puser;
+    clone->repdata.stable_input = thiz->repdata.stable_input;
+    mf_repdata_allocbuf (&clone->repdata);
+    
+    ac_trie_reset (clone);
+    clone->text = NULL;
+    clone->position = 0;
+    clone->wm = AC_WORKING_MODE_SEARCH;
+    
+    return clone;
+}
+
 /**
  * @brief Search in the input text using the given trie.
  * 
@@ -183,6 +293,13 @@ int ac_trie_search (AC_TRIE_t *thiz, AC_TEXT_t *text, int keep,
     if (thiz->trie_open)
         return -1;  /* Trie must be finalized first. */
     
+    if (thiz->match_mode != AC_MATCH_MODE_ALL)
+    {
+        if (!keep)
+            ac_trie_reset (thiz);
+        return ac_trie_search_leftmost (thiz, text, 0, callback, user);
+    }
+    
     if (thiz->wm == AC_WORKING_MODE_FINDNEXT)
         position = thiz->position;
     else
@@ -198,7 +315,7 @@ int ac_trie_search (AC_TRIE_t *thiz, AC_TEXT_t *text, int keep,
      */
     while (position < text->length)
     {
-        if (!(next = node_find_next_bs (current, text->astring[position])))
+        if (!(next = node_find_next_fast (current, text->astring[position])))
         {
             if(current->failure_node /* We are not in the root node */)
                 current = current->failure_node;
@@ -240,6 +357,225 @@ int ac_trie_search (AC_TRIE_t *thiz, AC_TEXT_t *text, int keep,
     return 0;
 }
 
+/**
+ * @brief Ends a search which is done chunk by chunk.
+ * 
+ * In the leftmost match modes, a match at the end of a chunk may be 
+ * overtaken by a longer or a higher priority match that continues in the 
+ * next chunk, so it is not reported until the next chunk comes. After the 
+ * last chunk, this function must be called to get the remaining matches; 
+ * then the trie is ready for a new search. In the default match mode it does 
+ * nothing.
+ * 
+ * @param thiz pointer to the trie
+ * @param callback
+ * @param user
+ * @return like ac_trie_search()
+ *****************************************************************************/
+int ac_trie_search_flush (AC_TRIE_t *thiz, 
+        AC_MATCH_CALBACK_f callback, void *user)
+{
+    int ret = 0;
+    
+    if (thiz->trie_open)
+        return -1;  /* Trie must be finalized first. */
+    
+    if (thiz->match_mode != AC_MATCH_MODE_ALL)
+        ret = ac_trie_search_leftmost (thiz, NULL, 1, callback, user);
+    
+    if (ret == 0)
+        ac_trie_reset (thiz);
+    
+    return ret;
+}
+
+/**
+ * @brief Searches the text in the leftmost match modes
+ * 
+ * Every match updates the candidate; the candidate is reported when the 
+ * current state of the automaton starts after the candidate, because no 
+ * other match can start before or at the candidate start any more. Then 
+ * the search restarts from the root at the end of the candidate, so the 
+ * matches inside or overlapping the reported one are never generated.
+ * 
+ * Restarting may go back to the alphas of the previous chunks; they are kept
+ * in the tail of the leftmost data.
+ * 
+ * @param thiz pointer to the trie
+ * @param text the input chunk, or NULL if @p flush is set
+ * @param flush indicates the end of the input
+ * @param callback
+ * @param user
+ * @return like ac_trie_search()
+ *****************************************************************************/
+static int ac_trie_search_leftmost (AC_TRIE_t *thiz, AC_TEXT_t *text, 
+        int flush, AC_MATCH_CALBACK_f callback, void *user)
+{
+    struct ac_leftmost *lm = &thiz->leftmost;
+    ACT_NODE_t *current = thiz->last_node;
+    ACT_NODE_t *next;
+    AC_MATCH_t match;
+    AC_ALPHABET_t alpha;
+    size_t length = text ? text->length : 0;
+    size_t position = lm->position;
+    size_t base = thiz->base_position;
+    size_t tail_base = base - lm->tail_length;
+    size_t end = base + length;
+    
+    while (1)
+    {
+        if (position < end)
+        {
+            alpha = (position < base) ? lm->tail[position - tail_base] : 
+                    text->astring[position - base];
+            
+            if (!(next = node_find_next_fast (current, alpha)))
+            {
+                if(current->failure_node /* We are not in the root node */)
+                    current = current->failure_node;
+                else
+                    position++;
+            }
+            else
+            {
+                current = next;
+                position++;
+            }
+            
+            if (current->final && next)
+                ac_trie_leftmost_candidate (thiz, current, position);
+            
+            /* Report the candidate if no other match can start before it */
+            if (!lm->pattern || position - current->depth <= lm->start)
+                continue;
+        }
+        else if (!flush || !lm->pattern)
+        {
+            break;
+        }
+        
+        /* Report the candidate and restart after it */
+        match.position = lm->end;
+        match.size = 1;
+        match.patterns = lm->pattern;
+        
+        lm->pattern = NULL;
+        position = lm->end;
+        current = thiz->root;
+        
+        if (callback (&match, user))
+        {
+            if (thiz->wm == AC_WORKING_MODE_FINDNEXT || flush)
+            {
+                /* Continue from here in the next call */
+                lm->position = position;
+                thiz->last_node = current;
+            }
+            else
+            {
+                /* The rest of the chunk is not searched */
+                lm->position = end;
+                lm->tail_length = 0;
+                thiz->last_node = thiz->root;
+                thiz->base_position = end;
+            }
+            return 1;
+        }
+    }
+    
+    /* Save status variables */
+    ac_trie_leftmost_savetail (thiz, text, current->depth);
+    lm->position = position;
+    thiz->last_node = current;
+    thiz->base_position = end;
+    
+    return 0;
+}
+
+/**
+ * @brief Updates the candidate of the leftmost match modes using the 
+ * matches of the given node
+ * 
+ * @param thiz pointer to the trie
+ * @param node the current node; it is final
+ * @param position the end position of the matches
+ *****************************************************************************/
+static void ac_trie_leftmost_candidate 
+    (AC_TRIE_t *thiz, ACT_NODE_t *node, size_t position)
+{
+    struct ac_leftmost *lm = &thiz->leftmost;
+    AC_PATTERN_t *patt;
+    ACT_NODE_t *owner;
+    size_t i, start;
+    
+    for (i = 0; i < node->matched_size; i++)
+    {
+        patt = &node->matched[i];
+        start = position - patt->ptext.length;
+        
+        if (lm->pattern && start > lm->start)
+            continue;
+        
+        if (thiz->match_mode == AC_MATCH_MODE_LEFTMOST_FIRST)
+        {
+            /* The node of the pattern is on the failure chain of the node */
+            for (owner = node; owner->depth > patt->ptext.length; )
+                owner = owner->failure_node;
+            
+            if (lm->pattern && start == lm->start && 
+                    owner->cold->order >= lm->order)
+                continue;
+            
+            lm->order = owner->cold->order;
+        }
+        
+        /* In the leftmost-longest mode, a match with the same start is 
+         * longer, because it ends later */
+        
+        lm->pattern = patt;
+        lm->start = start;
+        lm->end = position;
+    }
+}
+
+/**
+ * @brief Keeps the last alphas of the input, which may be read again in the
+ * next chunk
+ * 
+ * @param thiz pointer to the trie
+ * @param text the current chunk, or NULL
+ * @param length number of alphas to keep
+ *****************************************************************************/
+static void ac_trie_leftmost_savetail 
+    (AC_TRIE_t *thiz, AC_TEXT_t *text, size_t length)
+{
+    struct ac_leftmost *lm = &thiz->leftmost;
+    size_t text_length = text ? text->length : 0;
+    size_t from_tail;
+    
+    if (!lm->tail)
+        lm->tail = (AC_ALPHABET_t *) 
+                malloc (AC_PATTRN_MAX_LENGTH * sizeof(AC_ALPHABET_t));
+    
+    if (length > text_length)
+    {
+        /* A part of the old tail remains */
+        from_tail = length - text_length;
+        memmove (lm->tail, &lm->tail[lm->tail_length - from_tail], 
+                from_tail * sizeof(AC_ALPHABET_t));
+        if (text_length)
+            memcpy (&lm->tail[from_tail], text->astring, 
+                    text_length * sizeof(AC_ALPHABET_t));
+    }
+    else if (length)
+    {
+        memcpy (lm->tail, &text->astring[text_length - length], 
+                length * sizeof(AC_ALPHABET_t));
+    }
+    
+    lm->tail_length = length;
+}
+
 /**
  * @brief sets the input text to be searched by a function call to _findnext()
  * 
@@ -287,11 +623,20 @@ AC_MATCH_t ac_trie_findnext (AC_TRIE_t *thiz)
  *****************************************************************************/
 void ac_trie_release (AC_TRIE_t *thiz)
 {
-    /* It must be called with a 0 top-down parameter */
-    ac_trie_traverse_action (thiz->root, node_release_vectors, 0);
+    if (!thiz->shared)
+        /* It must be called with a 0 top-down parameter */
+        ac_trie_traverse_action (thiz->root, node_release_vectors, 0);
     
     mf_repdata_release (&thiz->repdata);
-    mpool_free(thiz->mp);
+    free (thiz->leftmost.tail);
+    free (thiz->sorted_path);
+    free (thiz->sorted_prefix);
+    
+    if (!thiz->shared)
+    {
+        mpool_free(thiz->mp);
+        mpool_free(thiz->cold_mp);
+    }
     free(thiz);
 }
 
@@ -331,6 +676,11 @@ static void ac_trie_reset (AC_TRIE_t *thiz)
 {
     thiz->last_node = thiz->root;
     thiz->base_position = 0;
+    
+    thiz->leftmost.pattern = NULL;
+    thiz->leftmost.position = 0;
+    thiz->leftmost.tail_length = 0;
+    
     mf_repdata_reset (&thiz->repdata);
 }
 
@@ -346,7 +696,7 @@ static void ac_trie_set_failure
 {
     size_t i, j;
     ACT_NODE_t *n;
-    ACT_NODE_t *root = node->trie->root;
+    ACT_NODE_t *root = node->cold->trie->root;
     
     if (node == root)
         return; /* Failure transition is not defined for the root */
@@ -395,6 +745,22 @@ static void ac_trie_traverse_setfailure
     }
 }
 
+/**
+ * @brief Sets the failure transition node for the nodes of a subtree of the
+ * root. It is a job for ac_parallel_run().
+ * 
+ * @param job index of the root outgoing edge
+ * @param param pointer to the root node
+ *****************************************************************************/
+static void ac_trie_setfailure_job (size_t job, void *param)
+{
+    ACT_NODE_t *root = (ACT_NODE_t *) param;
+    AC_ALPHABET_t prefix[AC_PATTRN_MAX_LENGTH];
+    
+    prefix[0] = root->outgoing[job].alpha;
+    ac_trie_traverse_setfailure (root->outgoing[job].next, prefix);
+}
+
 /**
  * @brief Traverses the trie using DFS method and applies the 
  * given @param func on all nodes. At top level it should be called by 
@@ -420,3 +786,34 @@ static void ac_trie_traverse_action
     if (!top_down)
         func (node);
 }
+
+/**
+ * @brief Traverses the trie in the breadth-first order and applies the given 
+ * @param func on all nodes. A node is visited after all the shallower nodes, 
+ * e.g. after its failure node.
+ * 
+ * @param thiz pointer to the trie
+ * @param func The function that must be applied to all nodes
+ *****************************************************************************/
+static void ac_trie_traverse_bfs 
+    (AC_TRIE_t *thiz, void(*func)(ACT_NODE_t *))
+{
+    ACT_NODE_t **queue;
+    ACT_NODE_t *node;
+    size_t i, head = 0, tail = 0;
+    
+    queue = (ACT_NODE_t **) malloc 
+            (thiz->nodes_count * sizeof(ACT_NODE_t *));
+    queue[tail++] = thiz->root;
+    
+    while (head < tail)
+    {
+        node = queue[head++];
+        func (node);
+        
+        for (i = 0; i < node->outgoing_size; i++)
+            queue[tail++] = node->outgoing[i].next;
+    }
+    
+    free (queue);
+}
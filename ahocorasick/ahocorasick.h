@@ -31,6 +31,24 @@ extern "C" {
 struct act_node;
 struct mpool;
 
+/**
+ * The search state of the leftmost match modes. A match is kept as a 
+ * candidate until no other match can start before or at its start; then it 
+ * is reported and the search restarts from its end.
+ */
+struct ac_leftmost
+{
+    AC_PATTERN_t *pattern;  /**< Pattern of the candidate match, or NULL */
+    size_t start;           /**< Start position of the candidate */
+    size_t end;             /**< End position of the candidate */
+    unsigned int order;     /**< Insertion order of the candidate pattern */
+    
+    size_t position;        /**< Position of the next alpha to read */
+    AC_ALPHABET_t *tail;    /**< End of the previous chunks; it may be read 
+                             * again after a match is reported */
+    size_t tail_length;     /**< Length of the tail */
+};
+
 /* 
  * The A.C. Trie data structure 
  */
@@ -39,12 +57,35 @@ typedef struct ac_trie
     struct act_node *root;      /**< The root node of the trie */
     
     size_t patterns_count;      /**< Total patterns in the trie */
+    size_t merged_count;        /**< Patterns merged into the pattern with 
+                                 * the same string; see merge_duplicates */
+    size_t nodes_count;         /**< Total nodes in the trie; node IDs are 
+                                 * dense and run from 0 to nodes_count-1 */
+    size_t edges_count;         /**< Total edges in the trie */
+    unsigned int next_order;    /**< Insertion order of the next pattern */
+    
+    unsigned int build_threads; /**< Number of threads used by 
+                                 * ac_trie_add_bulk() and ac_trie_finalize() */
+    short merge_duplicates; /**< Adding a duplicate pattern links it to the 
+                             * pattern with the same string as another 
+                             * identifier, instead of rejecting it */
+    
+    short edges_ordered;    /**< Indicates that the edges of every node are 
+                             * in the ascending order of their alphas */
+    struct act_node **sorted_path;  /**< Nodes on the path of the last pattern
+                                     * added by ac_trie_add_sorted() */
+    AC_ALPHABET_t *sorted_prefix;   /**< Alphas of that path */
+    size_t sorted_depth;            /**< Length of that path */
     
     short trie_open; /**< This flag indicates that if trie is finalized 
                           * or not. After finalizing the trie you can not 
                           * add pattern to trie anymore. */
     
+    short shared;   /**< Indicates that the nodes belong to another trie. 
+                     * See ac_trie_clone() */
+    
     struct mpool *mp;   /**< Memory pool */
+    struct mpool *cold_mp;  /**< Memory pool for the cold part of nodes */
     
     /* ******************* Thread specific part ******************** */
     
@@ -60,6 +101,9 @@ typedef struct ac_trie
     size_t position;    /**< A helper variable to hold the relative current 
                          * position in the given text */
     
+    AC_MATCH_MODE_t match_mode; /**< Which matches are reported by search */
+    struct ac_leftmost leftmost; /**< Search state of leftmost match modes */
+    
     MF_REPLACEMENT_DATA_t repdata;    /**< Replacement data structure */
     
     ACT_WORKING_MODE_t wm; /**< Working mode */
@@ -72,19 +116,47 @@ typedef struct ac_trie
 
 AC_TRIE_t *ac_trie_create (void);
 AC_STATUS_t ac_trie_add (AC_TRIE_t *thiz, AC_PATTERN_t *patt, int copy);
+AC_STATUS_t ac_trie_add_sorted (AC_TRIE_t *thiz, AC_PATTERN_t *patt, 
+        int copy);
+AC_STATUS_t ac_trie_add_bulk (AC_TRIE_t *thiz, AC_PATTERN_t *patts, 
+        size_t count, int copy, AC_STATUS_t *status);
 void ac_trie_finalize (AC_TRIE_t *thiz);
+AC_TRIE_t *ac_trie_clone (AC_TRIE_t *thiz);
 void ac_trie_release (AC_TRIE_t *thiz);
 void ac_trie_display (AC_TRIE_t *thiz);
 
 int  ac_trie_search (AC_TRIE_t *thiz, AC_TEXT_t *text, int keep, 
         AC_MATCH_CALBACK_f callback, void *param);
 
+int  ac_trie_search_flush (AC_TRIE_t *thiz, 
+        AC_MATCH_CALBACK_f callback, void *user);
 void ac_trie_settext (AC_TRIE_t *thiz, AC_TEXT_t *text, int keep);
 AC_MATCH_t ac_trie_findnext (AC_TRIE_t *thiz);
 
 int  multifast_replace (AC_TRIE_t *thiz, AC_TEXT_t *text, 
         MF_REPLACE_MODE_t mode, MF_REPLACE_CALBACK_f callback, void *param);
+int  multifast_replace_iov (AC_TRIE_t *thiz, AC_TEXT_t *text, 
+        MF_REPLACE_MODE_t mode, MF_REPLACE_SEGMENT_CALBACK_f callback, 
+        void *param);
+int  multifast_replace_buffer (AC_TRIE_t *thiz, AC_TEXT_t *text, 
+        MF_REPLACE_MODE_t mode, AC_TEXT_t *result);
+int  multifast_replace_into (AC_TRIE_t *thiz, AC_TEXT_t *text, 
+        MF_REPLACE_MODE_t mode, AC_ALPHABET_t *buffer, size_t size, 
+        size_t *length);
+int  multifast_replace_inplace (AC_TRIE_t *thiz, AC_ALPHABET_t *text, 
+        size_t length, MF_REPLACE_MODE_t mode);
+int  multifast_replace_parallel (AC_TRIE_t *thiz, AC_TEXT_t *text, 
+        MF_REPLACE_MODE_t mode, unsigned int threads, 
+        MF_REPLACE_CALBACK_f callback, void *param);
+int  multifast_replace_dryrun (AC_TRIE_t *thiz, AC_TEXT_t *text, 
+        MF_REPLACE_MODE_t mode);
 void multifast_rep_flush (AC_TRIE_t *thiz, int keep);
+void multifast_rep_stats (AC_TRIE_t *thiz, MF_REPLACE_STATS_t *stats, 
+        MF_REPLACE_COUNT_CALBACK_f callback, void *param);
+int  multifast_rep_set_bufsize (AC_TRIE_t *thiz, size_t size);
+void multifast_rep_set_callback (AC_TRIE_t *thiz, 
+        MF_REPLACE_PATTERN_CALBACK_f callback, void *user);
+void multifast_rep_set_stable (AC_TRIE_t *thiz, int stable);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,477 @@
+/*
+ * ahocorasick.hpp: A header-only C++17 interface of the Aho-Corasick library
+ * This file is part of multifast.
+ *
+    Copyright 2010-2015 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _AHOCORASICK_HPP_
+#define _AHOCORASICK_HPP_
+
+#include <cstddef>
+#include <iterator>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "ahocorasick.h"
+#include "node.h"
+
+namespace multifast
+{
+
+class MatchIterator;
+class MatchRange;
+
+/**
+ * A match of a pattern. The match ends right before 'position', so it starts
+ * at position - length.
+ */
+struct Match
+{
+    std::size_t position;   /**< End position of the match in the input */
+    std::size_t length;     /**< Length of the pattern */
+    long id;                /**< Numeric identifier of the pattern */
+    const AC_PATTERN_t *pattern;    /**< The pattern itself */
+};
+
+/**
+ * The trie, which owns an AC_TRIE_t. It can be moved but not copied.
+ *
+ * The text and the patterns are given as std::string_view. The matches are
+ * reported to a callable, which is a template parameter of search(); so the
+ * compiler can inline it into the search loop. The callable takes a
+ * const Match & and returns void, or bool to stop the search by true. The
+ * matches can also be iterated by matches().
+ */
+class Trie
+{
+public:
+
+    Trie () : m_trie (ac_trie_create ()), m_lastNode (nullptr),
+            m_basePosition (0)
+    {
+    }
+    
+    ~Trie ()
+    {
+        if (m_trie)
+            ac_trie_release (m_trie);
+    }
+    
+    Trie (const Trie &) = delete;
+    Trie &operator= (const Trie &) = delete;
+    
+    Trie (Trie &&other) noexcept
+        : m_trie (std::exchange (other.m_trie, nullptr)),
+          m_lastNode (std::exchange (other.m_lastNode, nullptr)),
+          m_basePosition (std::exchange (other.m_basePosition, 0))
+    {
+    }
+    
+    Trie &operator= (Trie &&other) noexcept
+    {
+        if (this != &other)
+        {
+            if (m_trie)
+                ac_trie_release (m_trie);
+            m_trie = std::exchange (other.m_trie, nullptr);
+            m_lastNode = std::exchange (other.m_lastNode, nullptr);
+            m_basePosition = std::exchange (other.m_basePosition, 0);
+        }
+        return *this;
+    }
+    
+    /** @brief The underlying trie, for the rest of the C interface */
+    AC_TRIE_t *get () const
+    {
+        return m_trie;
+    }
+    
+    /**
+     * @brief Adds a pattern. If copy is false, the pattern string must be
+     * valid for the life-time of the trie.
+     */
+    AC_STATUS_t addPattern (std::string_view pattern, long id,
+            bool copy = true)
+    {
+        AC_PATTERN_t patt;
+        
+        patt.ptext.astring = pattern.data ();
+        patt.ptext.length = pattern.size ();
+        patt.rtext.astring = nullptr;
+        patt.rtext.length = 0;
+        patt.id.u.number = id;
+        patt.id.type = AC_PATTID_TYPE_NUMBER;
+        
+        return ac_trie_add (m_trie, &patt, copy);
+    }
+    
+    void setMatchMode (AC_MATCH_MODE_t mode)
+    {
+        m_trie->match_mode = mode;
+    }
+    
+    void finalize ()
+    {
+        ac_trie_finalize (m_trie);
+        m_lastNode = m_trie->root;
+        m_basePosition = 0;
+    }
+    
+    /**
+     * @brief Searches the text. If keep is true, the text is the next chunk
+     * of the previous text, and the positions continue from there.
+     *
+     * In the leftmost match modes, the search is done by ac_trie_search()
+     * and flush() must be called after the last chunk.
+     *
+     * @return -1: the trie is not finalized, 0: the text was searched to the
+     * end, 1: the callback stopped the search
+     */
+    template <class Callback>
+    int search (std::string_view text, Callback &&callback, bool keep = false)
+    {
+        if (m_trie->trie_open)
+            return -1;
+        
+        if (m_trie->match_mode != AC_MATCH_MODE_ALL)
+        {
+            AC_TEXT_t actext = {text.data (), text.size ()};
+            
+            return ac_trie_search (m_trie, &actext, keep,
+                    &Trie::forward<std::remove_reference_t<Callback>>,
+                    const_cast<void *> (static_cast<const void *>
+                    (&callback)));
+        }
+        
+        const ACT_NODE_t *current = m_trie->root;
+        std::size_t base = 0;
+        std::size_t position = 0;
+        
+        if (keep && m_lastNode)
+        {
+            current = m_lastNode;
+            base = m_basePosition;
+        }
+        
+        while (walk (current, text, position))
+        {
+            if (report (current, base + position, callback))
+            {
+                m_lastNode = current;
+                m_basePosition = base + position;
+                return 1;
+            }
+        }
+        
+        m_lastNode = current;
+        m_basePosition = base + position;
+        return 0;
+    }
+    
+    /** @brief Ends a search which is done chunk by chunk */
+    template <class Callback>
+    int flush (Callback &&callback)
+    {
+        m_lastNode = m_trie->root;
+        m_basePosition = 0;
+        
+        return ac_trie_search_flush (m_trie,
+                &Trie::forward<std::remove_reference_t<Callback>>,
+                const_cast<void *> (static_cast<const void *> (&callback)));
+    }
+
+    /**
+     * @brief The matches of the text as a range; the automaton is walked
+     * lazily while the range is iterated. The range reports every match,
+     * whatever the match mode is. It is empty if the trie is not finalized.
+     */
+    MatchRange matches (std::string_view text) const;
+
+private:
+    
+    friend class MatchIterator;
+    
+    /**
+     * @brief Walks the text from the position to the next final node that
+     * is reached by an alpha transition. The same loop as ac_trie_search().
+     *
+     * @return false at the end of the text
+     */
+    static bool walk (const ACT_NODE_t *&node, std::string_view text,
+            std::size_t &position)
+    {
+        const ACT_NODE_t *next;
+        
+        while (position < text.size ())
+        {
+            if (!(next = findNext (node, text[position])))
+            {
+                if (node->failure_node)
+                    node = node->failure_node;
+                else
+                    position++;
+                continue;
+            }
+            
+            node = next;
+            position++;
+            
+            if (node->final)
+                return true;
+        }
+        return false;
+    }
+    
+    /** @brief Reports the matches of a final node; true stops the search */
+    template <class Callback>
+    static bool report (const ACT_NODE_t *node, std::size_t position,
+            Callback &callback)
+    {
+        for (std::size_t i = 0; i < node->matched_size; i++)
+        {
+            // Also the identifiers merged into the pattern
+            for (const AC_PATTERN_t *patt = &node->matched[i]; patt;
+                    patt = patt->merged)
+            {
+                Match match = {position, patt->ptext.length,
+                        patt->id.u.number, patt};
+                
+                if constexpr (std::is_void_v<
+                        std::invoke_result_t<Callback &, const Match &>>)
+                    callback (match);
+                else if (callback (match))
+                    return true;
+            }
+        }
+        return false;
+    }
+    
+    /** @brief Passes the matches of the C interface to the callable */
+    template <class Callback>
+    static int forward (AC_MATCH_t *m, void *param)
+    {
+        Callback &callback = *static_cast<Callback *> (param);
+        
+        for (std::size_t i = 0; i < m->size; i++)
+        {
+            for (const AC_PATTERN_t *patt = &m->patterns[i]; patt;
+                    patt = patt->merged)
+            {
+                Match match = {m->position, patt->ptext.length,
+                        patt->id.u.number, patt};
+                
+                if constexpr (std::is_void_v<
+                        std::invoke_result_t<Callback &, const Match &>>)
+                    callback (match);
+                else if (callback (match))
+                    return 1;
+            }
+        }
+        return 0;
+    }
+    
+    /** @brief An inline copy of node_find_next_fast() */
+    static const ACT_NODE_t *findNext (const ACT_NODE_t *node,
+            AC_ALPHABET_t alpha)
+    {
+        unsigned char key = static_cast<unsigned char> (alpha);
+        const void *index = &node->outgoing[node->outgoing_size];
+        
+        switch (node->edge_mode)
+        {
+            case ACT_EDGE_MODE_DIRECT:
+                return static_cast<ACT_NODE_t *const *> (index)[key];
+            
+            case ACT_EDGE_MODE_BITMAP:
+            {
+                auto bm = static_cast<const struct act_edge_bitmap *> (index);
+                unsigned int word = bm->bits[key >> 5];
+                unsigned int bit = 1U << (key & 31);
+                
+                if (!(word & bit))
+                    return nullptr;
+                
+                return node->outgoing[bm->rank[key >> 5] +
+                        popcount (word & (bit - 1))].next;
+            }
+            
+            default:
+                for (std::size_t i = 0; i < node->outgoing_size; i++)
+                    if (node->outgoing[i].alpha == alpha)
+                        return node->outgoing[i].next;
+                return nullptr;
+        }
+    }
+    
+    static unsigned int popcount (unsigned int x)
+    {
+#if defined(__GNUC__)
+        return __builtin_popcount (x);
+#else
+        x = x - ((x >> 1) & 0x55555555U);
+        x = (x & 0x33333333U) + ((x >> 2) & 0x33333333U);
+        x = (x + (x >> 4)) & 0x0F0F0F0FU;
+        return (x * 0x01010101U) >> 24;
+#endif
+    }
+    
+    AC_TRIE_t *m_trie;
+    const ACT_NODE_t *m_lastNode;   // Where the last chunk was left
+    std::size_t m_basePosition;     // Position of the next chunk
+};
+
+/**
+ * Forward iterator over the matches of a text. It walks the automaton on
+ * demand and does not allocate. The end iterator is default constructed.
+ */
+class MatchIterator
+{
+public:
+    
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Match;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Match *;
+    using reference = const Match &;
+    
+    MatchIterator () : m_node (nullptr), m_position (0), m_index (0),
+            m_pattern (nullptr), m_match ()
+    {
+    }
+    
+    MatchIterator (const ACT_NODE_t *root, std::string_view text)
+        : m_node (root), m_text (text), m_position (0), m_index (0),
+          m_pattern (nullptr), m_match ()
+    {
+        advance ();
+    }
+    
+    reference operator* () const
+    {
+        return m_match;
+    }
+    
+    pointer operator-> () const
+    {
+        return &m_match;
+    }
+    
+    MatchIterator &operator++ ()
+    {
+        // The merged identifiers and the other patterns of the node end at
+        // the same position
+        if (m_pattern->merged)
+        {
+            m_pattern = m_pattern->merged;
+            set ();
+        }
+        else if (++m_index < m_node->matched_size)
+        {
+            m_pattern = &m_node->matched[m_index];
+            set ();
+        }
+        else
+            advance ();
+        return *this;
+    }
+    
+    MatchIterator operator++ (int)
+    {
+        MatchIterator old = *this;
+        ++*this;
+        return old;
+    }
+    
+    bool operator== (const MatchIterator &other) const
+    {
+        return m_node == other.m_node && m_position == other.m_position &&
+                m_pattern == other.m_pattern;
+    }
+    
+    bool operator!= (const MatchIterator &other) const
+    {
+        return !(*this == other);
+    }
+    
+private:
+    
+    void advance ()
+    {
+        m_index = 0;
+        
+        if (Trie::walk (m_node, m_text, m_position))
+        {
+            m_pattern = &m_node->matched[0];
+            set ();
+        }
+        else
+            *this = MatchIterator ();
+    }
+    
+    void set ()
+    {
+        m_match.position = m_position;
+        m_match.length = m_pattern->ptext.length;
+        m_match.id = m_pattern->id.u.number;
+        m_match.pattern = m_pattern;
+    }
+    
+    const ACT_NODE_t *m_node;   // The final node of the match; null at end
+    std::string_view m_text;
+    std::size_t m_position;     // End position of the match
+    std::size_t m_index;        // The pattern of the match in the node
+    const AC_PATTERN_t *m_pattern;  // The pattern or a merged identifier
+    Match m_match;
+};
+
+/**
+ * The matches of a text; see Trie::matches()
+ */
+class MatchRange
+{
+public:
+    
+    MatchRange (const ACT_NODE_t *root, std::string_view text)
+        : m_root (root), m_text (text)
+    {
+    }
+    
+    MatchIterator begin () const
+    {
+        return m_root ? MatchIterator (m_root, m_text) : MatchIterator ();
+    }
+    
+    MatchIterator end () const
+    {
+        return MatchIterator ();
+    }
+    
+private:
+    
+    const ACT_NODE_t *m_root;   // Null if the trie is not finalized
+    std::string_view m_text;
+};
+
+inline MatchRange Trie::matches (std::string_view text) const
+{
+    return MatchRange (m_trie->trie_open ? nullptr : m_trie->root, text);
+}
+
+} // namespace multifast
+
+#endif
@@ -0,0 +1,694 @@
+/*
+ * bulk.c: Implements building the trie from a whole set of patterns at once
+ * 
+ * This file is part of multifast.
+ *
+    Copyright 2010-2015 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "node.h"
+#include "ahocorasick.h"
+#include "mpool.h"
+#include "parallel.h"
+
+/* Ranges smaller than this are sorted by insertion sort */
+#define AC_BULK_INSERTION_SORT_LIMIT 32
+
+/* Patterns are distributed over buckets by their first alpha */
+#define AC_BULK_BUCKETS 256
+
+#define AC_BULK_ALPHA(p,d) ((unsigned char)(p)->ptext.astring[d])
+
+/**
+ * A bucket holds the patterns that start with the same alpha. Every bucket 
+ * is a separate subtree of the root, so buckets can be sorted and built 
+ * independently.
+ */
+struct ac_bulk_bucket
+{
+    AC_PATTERN_t **patts;       /**< Patterns of the bucket (sorted) */
+    AC_PATTERN_t **tmp;         /**< Helper space used by the radix sort */
+    size_t size;                /**< Number of patterns in the bucket */
+    
+    size_t nodes_count;         /**< Number of nodes in the subtree */
+    size_t patterns_count;      /**< Number of accepted patterns */
+    size_t merged_count;        /**< Number of merged duplicates */
+    
+    ACT_NODE_t *nodes;          /**< Nodes of the subtree */
+    struct act_node_cold *colds;    /**< Cold parts of the nodes */
+    unsigned int first_id;      /**< ID of the first node of the bucket */
+    size_t next_node;           /**< The first unused node */
+    AC_PATTERN_t *merged;       /**< The merged duplicates of the subtree */
+    size_t next_merged;         /**< The first unused merged duplicate */
+};
+
+/**
+ * The bulk build data
+ */
+struct ac_bulk
+{
+    AC_TRIE_t *trie;
+    AC_PATTERN_t *patts;    /**< The input patterns */
+    AC_PATTERN_t *copies;   /**< Deep copies of the input patterns */
+    AC_STATUS_t *status;    /**< Status of every pattern */
+    unsigned int first_order;   /**< Insertion order of the first pattern */
+    
+    struct ac_bulk_bucket buckets[AC_BULK_BUCKETS];
+    unsigned int jobs[AC_BULK_BUCKETS]; /**< Non-empty buckets, biggest first */
+    size_t jobs_count;
+};
+
+/* Privates */
+
+static void ac_bulk_radix_sort 
+    (AC_PATTERN_t **a, AC_PATTERN_t **tmp, size_t n, size_t depth);
+
+static void ac_bulk_insertion_sort 
+    (AC_PATTERN_t **a, size_t n, size_t depth);
+
+static int ac_bulk_compare 
+    (AC_PATTERN_t *l, AC_PATTERN_t *r, size_t depth);
+
+static void ac_bulk_sort_job (size_t job, void *param);
+static void ac_bulk_build_job (size_t job, void *param);
+
+static void ac_bulk_build_node (struct ac_bulk *bulk, 
+        struct ac_bulk_bucket *bucket, ACT_NODE_t *node, 
+        size_t from, size_t to);
+
+static ACT_NODE_t *ac_bulk_new_node 
+    (struct ac_bulk *bulk, struct ac_bulk_bucket *bucket, size_t depth);
+
+
+/**
+ * @brief Adds a set of patterns to the trie at once.
+ * 
+ * The patterns are sorted by a radix sort and then the trie is built in one
+ * pass over the sorted patterns; every node is created once with an exactly 
+ * sized edge array and shared prefixes are never looked up. The subtrees of 
+ * the root are sorted and built in parallel using trie->build_threads 
+ * threads. 
+ * 
+ * The result is the same as adding the patterns one by one with _add() in 
+ * the given order: if there are duplicate patterns the first one is accepted,
+ * and the others are rejected or merged (see ac_trie_add()).
+ * If the trie already has patterns, the sorted patterns are added one by one
+ * using ac_trie_add_sorted().
+ * 
+ * @param thiz pointer to the trie
+ * @param patts array of patterns
+ * @param count number of patterns in the array
+ * @param copy see ac_trie_add()
+ * @param status optional array of @p count elements, receives the status of 
+ * adding every pattern
+ * 
+ * @return ACERR_TRIE_CLOSED if the trie is finalized, ACERR_SUCCESS otherwise
+ *****************************************************************************/
+AC_STATUS_t ac_trie_add_bulk (AC_TRIE_t *thiz, AC_PATTERN_t *patts, 
+        size_t count, int copy, AC_STATUS_t *status)
+{
+    struct ac_bulk *bulk;
+    struct ac_bulk_bucket *bucket;
+    AC_PATTERN_t **sorted, **tmp;
+    AC_PATTERN_t *patt;
+    AC_STATUS_t st;
+    ACT_NODE_t *root = thiz->root;
+    ACT_NODE_t *last;
+    AC_STATUS_t *own_status = NULL;
+    size_t i, j, valid = 0, pos, merged;
+    size_t sizes[AC_BULK_BUCKETS];
+    unsigned int b, id, order;
+    
+    if (!thiz->trie_open)
+        return ACERR_TRIE_CLOSED;
+    
+    /* The status is needed to tell the accepted patterns apart, even if the 
+     * caller does not ask for it */
+    if (!status)
+        status = own_status = (AC_STATUS_t *) 
+                malloc (count * sizeof(AC_STATUS_t));
+    
+    /* Validate the patterns and count the bucket sizes */
+    memset (sizes, 0, sizeof(sizes));
+    
+    for (i = 0; i < count; i++)
+    {
+        patt = &patts[i];
+        
+        if (!patt->ptext.length)
+            st = ACERR_ZERO_PATTERN;
+        else if (patt->ptext.length > AC_PATTRN_MAX_LENGTH)
+            st = ACERR_LONG_PATTERN;
+        else
+        {
+            st = ACERR_SUCCESS;
+            sizes[AC_BULK_ALPHA(patt, 0)]++;
+            valid++;
+        }
+        
+        status[i] = st;
+    }
+    
+    if (!valid)
+    {
+        free (own_status);
+        return ACERR_SUCCESS;
+    }
+    
+    sorted = (AC_PATTERN_t **) malloc (valid * sizeof(AC_PATTERN_t *));
+    tmp = (AC_PATTERN_t **) malloc (valid * sizeof(AC_PATTERN_t *));
+    
+    if (root->outgoing_size)
+    {
+        /* The trie is not empty; sort the patterns and add them one by one */
+        for (i = 0, pos = 0; i < count; i++)
+            if (patts[i].ptext.length && 
+                    patts[i].ptext.length <= AC_PATTRN_MAX_LENGTH)
+                sorted[pos++] = &patts[i];
+        
+        ac_bulk_radix_sort (sorted, tmp, valid, 0);
+        
+        for (i = 0, order = thiz->next_order; i < valid; i++)
+        {
+            merged = thiz->merged_count;
+            st = ac_trie_add_sorted (thiz, sorted[i], copy);
+            status[sorted[i] - patts] = st;
+            
+            last = thiz->sorted_path[sorted[i]->ptext.length];
+            
+            /* The insertion order is the order of the input; a merged 
+             * duplicate keeps the order of the first pattern */
+            if (st == ACERR_SUCCESS && thiz->merged_count == merged)
+                last->cold->order = order + (sorted[i] - patts);
+        }
+        thiz->next_order = order + count;
+        
+        free (sorted);
+        free (tmp);
+        free (own_status);
+        return ACERR_SUCCESS;
+    }
+    
+    bulk = (struct ac_bulk *) calloc (1, sizeof(struct ac_bulk));
+    bulk->trie = thiz;
+    bulk->patts = patts;
+    bulk->status = status;
+    bulk->first_order = thiz->next_order;
+    
+    /* The first pass of the radix sort: distribute patterns over the
+     * buckets keeping their order */
+    for (b = 0, pos = 0; b < AC_BULK_BUCKETS; b++)
+    {
+        bucket = &bulk->buckets[b];
+        bucket->patts = &sorted[pos];
+        bucket->tmp = &tmp[pos];
+        pos += sizes[b];
+    }
+    
+    for (i = 0; i < count; i++)
+    {
+        patt = &patts[i];
+        if (patt->ptext.length && patt->ptext.length <= AC_PATTRN_MAX_LENGTH)
+        {
+            bucket = &bulk->buckets[AC_BULK_ALPHA(patt, 0)];
+            bucket->patts[bucket->size++] = patt;
+        }
+    }
+    
+    /* Make the job list; bigger buckets go first */
+    for (b = 0; b < AC_BULK_BUCKETS; b++)
+    {
+        if (!sizes[b])
+            continue;
+        
+        for (j = bulk->jobs_count; 
+                j > 0 && sizes[bulk->jobs[j-1]] < sizes[b]; j--)
+            bulk->jobs[j] = bulk->jobs[j-1];
+        
+        bulk->jobs[j] = b;
+        bulk->jobs_count++;
+    }
+    
+    /* Sort the buckets and count the nodes */
+    ac_parallel_run (thiz->build_threads, bulk->jobs_count, 
+            ac_bulk_sort_job, bulk);
+    
+    /* Memory pools are not thread-safe, so the allocations are done here. 
+     * Only the accepted patterns are copied */
+    if (copy)
+    {
+        bulk->copies = (AC_PATTERN_t *) malloc (count * sizeof(AC_PATTERN_t));
+        
+        for (i = 0; i < count; i++)
+            if (status[i] == ACERR_SUCCESS)
+                node_copy_pattern (thiz->mp, &bulk->copies[i], &patts[i]);
+    }
+    
+    id = thiz->nodes_count;
+    
+    root->outgoing = (struct act_edge *) 
+            malloc (bulk->jobs_count * sizeof(struct act_edge));
+    root->cold->outgoing_capacity = bulk->jobs_count;
+    
+    for (b = 0; b < AC_BULK_BUCKETS; b++)
+    {
+        bucket = &bulk->buckets[b];
+        
+        if (!bucket->size)
+            continue;
+        
+        bucket->nodes = (ACT_NODE_t *) mpool_malloc (thiz->mp, 
+                bucket->nodes_count * sizeof(ACT_NODE_t));
+        bucket->colds = (struct act_node_cold *) mpool_malloc (thiz->cold_mp, 
+                bucket->nodes_count * sizeof(struct act_node_cold));
+        bucket->first_id = id;
+        id += bucket->nodes_count;
+        
+        if (bucket->merged_count)
+            bucket->merged = (AC_PATTERN_t *) mpool_malloc (thiz->mp, 
+                    bucket->merged_count * sizeof(AC_PATTERN_t));
+        
+        /* The first node of every bucket is a child of the root */
+        node_init (&bucket->nodes[0], &bucket->colds[0], thiz);
+        bucket->nodes[0].cold->id = bucket->first_id;
+        bucket->nodes[0].depth = 1;
+        bucket->next_node = 1;
+        
+        root->outgoing[root->outgoing_size].alpha = (AC_ALPHABET_t) b;
+        root->outgoing[root->outgoing_size].next = &bucket->nodes[0];
+        root->outgoing_size++;
+    }
+    
+    /* Build the subtrees */
+    ac_parallel_run (thiz->build_threads, bulk->jobs_count, 
+            ac_bulk_build_job, bulk);
+    
+    /* Every node has exactly one incoming edge */
+    thiz->nodes_count = id;
+    thiz->edges_count = id - 1;
+    
+    for (b = 0; b < AC_BULK_BUCKETS; b++)
+    {
+        thiz->patterns_count += bulk->buckets[b].patterns_count;
+        thiz->merged_count += bulk->buckets[b].merged_count;
+    }
+    
+    thiz->next_order += count;
+    
+    free (bulk->copies);
+    free (sorted);
+    free (tmp);
+    free (bulk);
+    free (own_status);
+    
+    return ACERR_SUCCESS;
+}
+
+/**
+ * @brief Adds a pattern to the trie; the patterns are expected to be given 
+ * in lexicographic order.
+ * 
+ * The nodes on the path of the previous pattern are kept, so the common 
+ * prefix is not looked up again. While the patterns come in order, new 
+ * edges are appended without looking them up. Patterns out of order are 
+ * still added correctly, only slower; it is like calling ac_trie_add().
+ * 
+ * @param thiz pointer to the trie
+ * @param patt pointer to the pattern
+ * @param copy see ac_trie_add()
+ * 
+ * @return The return value indicates the success or failure of adding action
+ *****************************************************************************/
+AC_STATUS_t ac_trie_add_sorted (AC_TRIE_t *thiz, AC_PATTERN_t *patt, int copy)
+{
+    size_t i, length = patt->ptext.length;
+    ACT_NODE_t *n, *next, **path;
+    AC_ALPHABET_t alpha, *prefix;
+    
+    if(!thiz->trie_open)
+        return ACERR_TRIE_CLOSED;
+    
+    if (!length)
+        return ACERR_ZERO_PATTERN;
+    
+    if (length > AC_PATTRN_MAX_LENGTH)
+        return ACERR_LONG_PATTERN;
+    
+    if (!thiz->sorted_path)
+    {
+        thiz->sorted_path = (ACT_NODE_t **) malloc 
+                ((AC_PATTRN_MAX_LENGTH + 1) * sizeof(ACT_NODE_t *));
+        thiz->sorted_prefix = (AC_ALPHABET_t *) malloc 
+                (AC_PATTRN_MAX_LENGTH * sizeof(AC_ALPHABET_t));
+        thiz->sorted_path[0] = thiz->root;
+        thiz->sorted_depth = 0;
+    }
+    
+    path = thiz->sorted_path;
+    prefix = thiz->sorted_prefix;
+    
+    /* Skip the common prefix with the previous pattern */
+    for (i = 0; i < thiz->sorted_depth && i < length && 
+            prefix[i] == patt->ptext.astring[i]; i++)
+        ;
+    
+    for (n = path[i]; i < length; i++)
+    {
+        alpha = patt->ptext.astring[i];
+        
+        if (thiz->edges_ordered && (!n->outgoing_size || (unsigned char) 
+                n->outgoing[n->outgoing_size-1].alpha < (unsigned char) alpha))
+            /* The edge comes after all existing edges */
+            next = NULL;
+        else
+            next = node_find_next (n, alpha);
+        
+        if (!next)
+        {
+            next = node_create (thiz);
+            next->depth = n->depth + 1;
+            node_add_edge (n, next, alpha);
+        }
+        
+        n = next;
+        prefix[i] = alpha;
+        path[i + 1] = n;
+    }
+    thiz->sorted_depth = length;
+    
+    if(n->final)
+    {
+        /* The first pattern keeps the order and the replacement */
+        if (!thiz->merge_duplicates)
+            return ACERR_DUPLICATE_PATTERN;
+        
+        node_merge_pattern (n, patt, copy);
+        thiz->patterns_count++;
+        thiz->merged_count++;
+        return ACERR_SUCCESS;
+    }
+    
+    n->final = 1;
+    n->cold->order = thiz->next_order++;
+    node_accept_pattern (n, patt, copy);
+    thiz->patterns_count++;
+    
+    return ACERR_SUCCESS;
+}
+
+/**
+ * @brief Sorts a bucket and counts its nodes. Also finds out the duplicate
+ * patterns, or counts them if they are merged.
+ * 
+ * @param job
+ * @param param
+ *****************************************************************************/
+static void ac_bulk_sort_job (size_t job, void *param)
+{
+    struct ac_bulk *bulk = (struct ac_bulk *) param;
+    struct ac_bulk_bucket *bucket = &bulk->buckets[bulk->jobs[job]];
+    AC_PATTERN_t *prev = NULL, *cur;
+    size_t i, lcp, min;
+    
+    /* All the patterns of the bucket share the first alpha */
+    ac_bulk_radix_sort (bucket->patts, bucket->tmp, bucket->size, 1);
+    
+    /* In the sorted list, every pattern adds as many nodes as its length 
+     * minus its common prefix with the previous pattern */
+    for (i = 0; i < bucket->size; i++)
+    {
+        cur = bucket->patts[i];
+        lcp = 0;
+        
+        if (prev)
+        {
+            min = prev->ptext.length < cur->ptext.length ? 
+                prev->ptext.length : cur->ptext.length;
+            
+            while (lcp < min && 
+                    prev->ptext.astring[lcp] == cur->ptext.astring[lcp])
+                lcp++;
+            
+            if (lcp == cur->ptext.length && lcp == prev->ptext.length)
+            {
+                if (bulk->trie->merge_duplicates)
+                    bucket->merged_count++;
+                else
+                    bulk->status[cur - bulk->patts] = ACERR_DUPLICATE_PATTERN;
+                continue;
+            }
+        }
+        
+        bucket->nodes_count += cur->ptext.length - lcp;
+        prev = cur;
+    }
+}
+
+/**
+ * @brief Builds the subtree of a bucket
+ * 
+ * @param job
+ * @param param
+ *****************************************************************************/
+static void ac_bulk_build_job (size_t job, void *param)
+{
+    struct ac_bulk *bulk = (struct ac_bulk *) param;
+    struct ac_bulk_bucket *bucket = &bulk->buckets[bulk->jobs[job]];
+    
+    ac_bulk_build_node (bulk, bucket, &bucket->nodes[0], 0, bucket->size);
+}
+
+/**
+ * @brief Builds the subtree of a node using a range of sorted patterns.
+ * 
+ * @param bulk
+ * @param bucket
+ * @param node the node; all patterns in the range start with its prefix
+ * @param from start of the range
+ * @param to end of the range
+ *****************************************************************************/
+static void ac_bulk_build_node (struct ac_bulk *bulk, 
+        struct ac_bulk_bucket *bucket, ACT_NODE_t *node, 
+        size_t from, size_t to)
+{
+    AC_PATTERN_t **patts = bucket->patts;
+    AC_PATTERN_t *patt, *merged;
+    size_t depth = node->depth;
+    size_t i, group, children = 0;
+    ACT_NODE_t *child;
+    struct act_edge *edge;
+    
+    /* The patterns equal to the node prefix are sorted first */
+    for (i = from; i < to && patts[i]->ptext.length == depth; i++)
+    {
+        patt = patts[i];
+        
+        if (node->final)
+        {
+            /* Duplicate */
+            if (!bulk->trie->merge_duplicates)
+                continue;
+            
+            /* Its space is allocated after the sort */
+            merged = &bucket->merged[bucket->next_merged++];
+            *merged = bulk->copies ? bulk->copies[patt - bulk->patts] : *patt;
+            node_link_merged (node, merged);
+            bucket->patterns_count++;
+            continue;
+        }
+        
+        node->final = 1;
+        node->cold->order = bulk->first_order + (patt - bulk->patts);
+        node_accept_pattern (node, bulk->copies ? 
+                &bulk->copies[patt - bulk->patts] : patt, 0);
+        bucket->patterns_count++;
+    }
+    from = i;
+    
+    if (from == to)
+        return;
+    
+    /* Count the children to make an exactly sized edge array */
+    for (i = from; i < to; i++)
+        if (i == from || AC_BULK_ALPHA(patts[i], depth) != 
+                AC_BULK_ALPHA(patts[i-1], depth))
+            children++;
+    
+    node->outgoing = (struct act_edge *) 
+            malloc (children * sizeof(struct act_edge));
+    node->cold->outgoing_capacity = children;
+    
+    for (group = from; group < to; group = i)
+    {
+        for (i = group + 1; i < to && AC_BULK_ALPHA(patts[i], depth) == 
+                AC_BULK_ALPHA(patts[group], depth); i++)
+            ;
+        
+        child = ac_bulk_new_node (bulk, bucket, depth + 1);
+        
+        edge = &node->outgoing[node->outgoing_size++];
+        edge->alpha = patts[group]->ptext.astring[depth];
+        edge->next = child;
+        
+        ac_bulk_build_node (bulk, bucket, child, group, i);
+    }
+}
+
+/**
+ * @brief Takes the next pre-allocated node of the bucket
+ * 
+ * @param bulk
+ * @param bucket
+ * @param depth
+ * @return 
+ *****************************************************************************/
+static ACT_NODE_t *ac_bulk_new_node 
+    (struct ac_bulk *bulk, struct ac_bulk_bucket *bucket, size_t depth)
+{
+    size_t k = bucket->next_node++;
+    ACT_NODE_t *node = &bucket->nodes[k];
+    
+    node_init (node, &bucket->colds[k], bulk->trie);
+    node->cold->id = bucket->first_id + k;
+    node->depth = depth;
+    
+    return node;
+}
+
+/**
+ * @brief Sorts the patterns by MSD radix sort. The sort is stable.
+ * 
+ * @param a the array of patterns; all of them share the first @p depth alphas
+ * @param tmp helper array with the same size
+ * @param n number of patterns
+ * @param depth
+ *****************************************************************************/
+static void ac_bulk_radix_sort 
+    (AC_PATTERN_t **a, AC_PATTERN_t **tmp, size_t n, size_t depth)
+{
+    size_t count[AC_BULK_BUCKETS + 1];
+    size_t i, start, key;
+    
+    while (n >= AC_BULK_INSERTION_SORT_LIMIT)
+    {
+        /* Key 0 is for the patterns that end here, so they come first */
+        memset (count, 0, sizeof(count));
+        
+        for (i = 0; i < n; i++)
+        {
+            key = (a[i]->ptext.length > depth) ? 
+                AC_BULK_ALPHA(a[i], depth) + 1 : 0;
+            count[key]++;
+        }
+        
+        for (key = 0; key <= AC_BULK_BUCKETS; key++)
+            if (count[key] == n)
+                break;
+        
+        if (key == 0)
+            return; /* All equal */
+        
+        if (key <= AC_BULK_BUCKETS)
+        {
+            /* All the patterns have the same alpha here; go deeper without 
+             * recursion */
+            depth++;
+            continue;
+        }
+        
+        for (key = 0, start = 0; key <= AC_BULK_BUCKETS; key++)
+        {
+            i = count[key];
+            count[key] = start;
+            start += i;
+        }
+        
+        for (i = 0; i < n; i++)
+        {
+            key = (a[i]->ptext.length > depth) ? 
+                AC_BULK_ALPHA(a[i], depth) + 1 : 0;
+            tmp[count[key]++] = a[i];
+        }
+        
+        memcpy (a, tmp, n * sizeof(AC_PATTERN_t *));
+        
+        /* Now count[key] is the end of the bucket 'key' */
+        for (key = 1, start = count[0]; key <= AC_BULK_BUCKETS; key++)
+        {
+            if (count[key] - start > 1)
+                ac_bulk_radix_sort (&a[start], &tmp[start], 
+                        count[key] - start, depth + 1);
+            start = count[key];
+        }
+        return;
+    }
+    
+    ac_bulk_insertion_sort (a, n, depth);
+}
+
+/**
+ * @brief Sorts a small number of patterns. The sort is stable.
+ * 
+ * @param a
+ * @param n
+ * @param depth all patterns share the first @p depth alphas
+ *****************************************************************************/
+static void ac_bulk_insertion_sort (AC_PATTERN_t **a, size_t n, size_t depth)
+{
+    size_t i, j;
+    AC_PATTERN_t *patt;
+    
+    for (i = 1; i < n; i++)
+    {
+        patt = a[i];
+        
+        for (j = i; j > 0 && ac_bulk_compare (a[j-1], patt, depth) > 0; j--)
+            a[j] = a[j-1];
+        
+        a[j] = patt;
+    }
+}
+
+/**
+ * @brief Compares two patterns by their alphas as unsigned bytes, starting 
+ * from the given depth
+ * 
+ * @param l
+ * @param r
+ * @param depth
+ * @return less than, equal to, or greater than zero
+ *****************************************************************************/
+static int ac_bulk_compare (AC_PATTERN_t *l, AC_PATTERN_t *r, size_t depth)
+{
+    size_t min = l->ptext.length < r->ptext.length ? 
+        l->ptext.length : r->ptext.length;
+    int ret = 0;
+    
+    if (min > depth)
+        ret = memcmp (l->ptext.astring + depth, r->ptext.astring + depth, 
+                (min - depth) * sizeof(AC_ALPHABET_t));
+    
+    if (ret)
+        return ret;
+    
+    if (l->ptext.length == r->ptext.length)
+        return 0;
+    
+    return (l->ptext.length < r->ptext.length) ? -1 : 1;
+}
@@ -27,13 +27,16 @@
 #include "ahocorasick.h"
 
 /* Privates */
-static void node_init (ACT_NODE_t *thiz);
 static int  node_edge_compare (const void *l, const void *r);
-static int  node_has_pattern (ACT_NODE_t *thiz, AC_PATTERN_t *patt);
 static void node_grow_outgoing_vector (ACT_NODE_t *thiz);
 static void node_grow_matched_vector (ACT_NODE_t *thiz);
-static void node_copy_pattern (ACT_NODE_t *thiz, 
-        AC_PATTERN_t *to, AC_PATTERN_t *from);
+static unsigned int node_popcount (unsigned int x);
+
+/* Nodes with more edges use the bitmap */
+#define NODE_LINEAR_MAX_EDGES 4
+
+/* Nodes with this many edges, and the root, use the direct table */
+#define NODE_DIRECT_MIN_EDGES 64
 
 /**
  * @brief Creates the node
@@ -43,33 +46,47 @@ static void node_copy_pattern (ACT_NODE_t *thiz,
 struct act_node * node_create (struct ac_trie *trie)
 {
     ACT_NODE_t *node;
+    struct act_node_cold *cold;
     
     node = (ACT_NODE_t *) mpool_malloc (trie->mp, sizeof(ACT_NODE_t));
-    node_init (node);
-    node->trie = trie;
+    
+    /* The cold parts are kept in a separate pool, so the hot parts of the 
+     * nodes are packed closer together */
+    cold = (struct act_node_cold *) 
+            mpool_malloc (trie->cold_mp, sizeof(struct act_node_cold));
+    
+    node_init (node, cold, trie);
+    node_assign_id (node);
     
     return node;
 }
 
 /**
- * @brief Initializes the node
+ * @brief Initializes the node on the given memory. The node ID is not 
+ * assigned here.
  * 
  * @param thiz 
+ * @param cold The cold part of the node
+ * @param trie The trie that the node belongs to
  *****************************************************************************/
-static void node_init (ACT_NODE_t *thiz)
+void node_init (ACT_NODE_t *thiz, struct act_node_cold *cold, 
+        struct ac_trie *trie)
 {
-    node_assign_id (thiz);
+    thiz->cold = cold;
+    cold->trie = trie;
     
     thiz->final = 0;
+    thiz->edge_mode = ACT_EDGE_MODE_LINEAR;
     thiz->failure_node = NULL;
     thiz->depth = 0;
     
     thiz->matched = NULL;
-    thiz->matched_capacity = 0;
+    thiz->cold->matched_capacity = 0;
+    thiz->cold->last_merged = NULL;
     thiz->matched_size = 0;
     
     thiz->outgoing = NULL;
-    thiz->outgoing_capacity = 0;
+    thiz->cold->outgoing_capacity = 0;
     thiz->outgoing_size = 0;
     
     thiz->to_be_replaced = NULL;
@@ -120,7 +137,7 @@ ACT_NODE_t *node_find_next_bs (ACT_NODE_t *nod, AC_ALPHABET_t alpha)
 {
     size_t mid;
     int min, max;
-    AC_ALPHABET_t amid;
+    unsigned char amid, key = (unsigned char) alpha;
 
     min = 0;
     max = nod->outgoing_size - 1;
@@ -128,10 +145,10 @@ ACT_NODE_t *node_find_next_bs (ACT_NODE_t *nod, AC_ALPHABET_t alpha)
     while (min <= max)
     {
         mid = (min + max) >> 1;
-        amid = nod->outgoing[mid].alpha;
-        if (alpha > amid)
+        amid = (unsigned char) nod->outgoing[mid].alpha;
+        if (key > amid)
             min = mid + 1;
-        else if (alpha < amid)
+        else if (key < amid)
             max = mid - 1;
         else
             return (nod->outgoing[mid].next);
@@ -140,38 +157,43 @@ ACT_NODE_t *node_find_next_bs (ACT_NODE_t *nod, AC_ALPHABET_t alpha)
 }
 
 /**
- * @brief Determines if a final node contains a pattern in its accepted pattern
- * list or not.
+ * @brief Finds out the next node for a given alpha using the method that is 
+ * chosen for the node by node_index_edges(). It is used in the search loops.
+ * ahocorasick.hpp has an inline copy of it.
  * 
- * @param thiz
- * @param newstr
- * @return 1: has the pattern, 0: doesn't have it
+ * @param nod
+ * @param alpha
+ * @return 
  *****************************************************************************/
-static int node_has_pattern (ACT_NODE_t *thiz, AC_PATTERN_t *patt)
+ACT_NODE_t *node_find_next_fast (ACT_NODE_t *nod, AC_ALPHABET_t alpha)
 {
-    size_t i, j;
-    AC_TEXT_t *txt;
-    AC_TEXT_t *new_txt = &patt->ptext;
+    size_t i;
+    unsigned char key = (unsigned char) alpha;
+    unsigned int word, bit;
+    struct act_edge_bitmap *bm;
     
-    for (i = 0; i < thiz->matched_size; i++)
+    switch (nod->edge_mode)
     {
-        txt = &thiz->matched[i].ptext;
-        
-        if (txt->length != new_txt->length)
-            continue;
-        
-        /* The following loop is futile! Because the input pattern always come 
-         * from a failure node, and if they have the same length, then they are
-         * equal. But for the sake of functional integrity we leave it here. */
-        
-        for (j = 0; j < txt->length; j++)
-            if (txt->astring[j] != new_txt->astring[j])
-                break;
-        
-        if (j == txt->length)
-            return 1;
+        case ACT_EDGE_MODE_DIRECT:
+            return ((ACT_NODE_t **) &nod->outgoing[nod->outgoing_size])[key];
+            
+        case ACT_EDGE_MODE_BITMAP:
+            bm = (struct act_edge_bitmap *) &nod->outgoing[nod->outgoing_size];
+            word = bm->bits[key >> 5];
+            bit = 1U << (key & 31);
+            
+            if (!(word & bit))
+                return NULL;
+            
+            i = bm->rank[key >> 5] + node_popcount (word & (bit - 1));
+            return nod->outgoing[i].next;
+            
+        default:
+            for (i = 0; i < nod->outgoing_size; i++)
+                if (nod->outgoing[i].alpha == alpha)
+                    return nod->outgoing[i].next;
+            return NULL;
     }
-    return 0;
 }
 
 /**
@@ -189,7 +211,7 @@ ACT_NODE_t *node_create_next (ACT_NODE_t *nod, AC_ALPHABET_t alpha)
         /* The edge already exists */
         return NULL;
     
-    next = node_create (nod->trie);
+    next = node_create (nod->cold->trie);
     node_add_edge (nod, next, alpha);
     
     return next;
@@ -206,12 +228,8 @@ void node_accept_pattern (ACT_NODE_t *nod, AC_PATTERN_t *new_patt, int copy)
 {
     AC_PATTERN_t *patt;
     
-    /* Check if the new pattern already exists in the node list */
-    if (node_has_pattern(nod, new_patt))
-        return;
-    
     /* Manage memory */
-    if (nod->matched_size == nod->matched_capacity)
+    if (nod->matched_size == nod->cold->matched_capacity)
         node_grow_matched_vector (nod);
     
     patt = &nod->matched[nod->matched_size++];
@@ -219,27 +237,73 @@ void node_accept_pattern (ACT_NODE_t *nod, AC_PATTERN_t *new_patt, int copy)
     if (copy)
     {
         /* Deep copy */
-        node_copy_pattern (nod, patt, new_patt);
+        node_copy_pattern (nod->cold->trie->mp, patt, new_patt);
     }
     else
     {
         /* Shallow copy */
         *patt = *new_patt;
     }
+    
+    patt->merged = NULL;
+}
+
+/**
+ * @brief Adds a pattern with the same string as the accepted pattern of a 
+ * final node, as another identifier of that pattern. It is linked to the end 
+ * of the 'merged' list of the accepted pattern, so the matched vectors hold 
+ * one pattern for each string however many identifiers it has.
+ * 
+ * @param nod the final node; its matches are not collected yet
+ * @param new_patt
+ * @param copy
+ *****************************************************************************/
+void node_merge_pattern (ACT_NODE_t *nod, AC_PATTERN_t *new_patt, int copy)
+{
+    struct mpool *mp = nod->cold->trie->mp;
+    AC_PATTERN_t *patt = (AC_PATTERN_t *) 
+            mpool_malloc (mp, sizeof(AC_PATTERN_t));
+    
+    if (copy)
+        node_copy_pattern (mp, patt, new_patt);
+    else
+        *patt = *new_patt;
+    
+    node_link_merged (nod, patt);
+}
+
+/**
+ * @brief Links a pattern which is owned by the trie to the end of the 
+ * 'merged' list of the accepted pattern of a final node; see 
+ * node_merge_pattern(). It does not allocate memory.
+ * 
+ * @param nod the final node
+ * @param patt
+ *****************************************************************************/
+void node_link_merged (ACT_NODE_t *nod, AC_PATTERN_t *patt)
+{
+    struct act_node_cold *cold = nod->cold;
+    
+    patt->merged = NULL;
+    
+    if (cold->last_merged)
+        cold->last_merged->merged = patt;
+    else
+        nod->matched[0].merged = patt;
+    
+    cold->last_merged = patt;
 }
 
 /**
  * @brief Makes a deep copy of the pattern
  * 
- * @param thiz pointer to the owner node
+ * @param mp the memory pool that holds the copy
  * @param from 
  * @param to
  *****************************************************************************/
-static void node_copy_pattern
-    (ACT_NODE_t *thiz, AC_PATTERN_t *to, AC_PATTERN_t *from)
+void node_copy_pattern
+    (struct mpool *mp, AC_PATTERN_t *to, AC_PATTERN_t *from)
 {
-    struct mpool *mp = thiz->trie->mp;
-    
     to->ptext.astring = (AC_ALPHABET_t *) mpool_strndup (mp, 
         (const char *) from->ptext.astring, 
         from->ptext.length * sizeof(AC_ALPHABET_t));
@@ -270,24 +334,30 @@ void node_add_edge (ACT_NODE_t *nod, ACT_NODE_t *next, AC_ALPHABET_t alpha)
 {
     struct act_edge *oe; /* Outgoing edge */
     
-    if(nod->outgoing_size == nod->outgoing_capacity)
+    if(nod->outgoing_size == nod->cold->outgoing_capacity)
         node_grow_outgoing_vector (nod);
     
+    if (nod->outgoing_size && (unsigned char) alpha <= 
+            (unsigned char) nod->outgoing[nod->outgoing_size-1].alpha)
+        /* The edges are not appended in order any more */
+        nod->cold->trie->edges_ordered = 0;
+    
     oe = &nod->outgoing[nod->outgoing_size];
     oe->alpha = alpha;
     oe->next = next;
     nod->outgoing_size++;
+    nod->cold->trie->edges_count++;
 }
 
 /**
- * @brief Assigns a unique ID to the node (used for debugging purpose)
+ * @brief Assigns a unique ID to the node. IDs are dense and counted per trie, 
+ * so tries can be built in different threads at the same time.
  * 
  * @param thiz
  *****************************************************************************/
 void node_assign_id (ACT_NODE_t *nod)
 {
-    static int unique_id = 1;
-    nod->id = unique_id++;
+    nod->cold->id = nod->cold->trie->nodes_count++;
 }
 
 /**
@@ -307,7 +377,8 @@ static int node_edge_compare (const void *l, const void *r)
      * NOTE: Because edge alphabets are unique in every node we ignore
      * equivalence case.
      */
-    if (((struct act_edge *)l)->alpha >= ((struct act_edge *)r)->alpha)
+    if ((unsigned char)((struct act_edge *)l)->alpha >= 
+            (unsigned char)((struct act_edge *)r)->alpha)
         return 1;
     else
         return -1;
@@ -324,6 +395,80 @@ void node_sort_edges (ACT_NODE_t *nod)
             sizeof(struct act_edge), node_edge_compare);
 }
 
+/**
+ * @brief Chooses the edge lookup method of the node and builds its index.
+ * 
+ * Narrow nodes are searched linearly; medium nodes get a bitmap of alphas, so 
+ * the rank of an alpha gives its edge; wide nodes and the root get a table 
+ * of next nodes indexed by alpha. The index is stored right after the edges 
+ * in the same memory block. The edges must be sorted already.
+ * 
+ * @param nod
+ *****************************************************************************/
+void node_index_edges (ACT_NODE_t *nod)
+{
+    size_t i, edges_size = nod->outgoing_size * sizeof(struct act_edge);
+    unsigned char key;
+    ACT_NODE_t **table;
+    struct act_edge_bitmap *bm;
+    
+    if (nod->outgoing_size >= NODE_DIRECT_MIN_EDGES || nod->depth == 0)
+    {
+        nod->outgoing = (struct act_edge *) realloc (nod->outgoing, 
+                edges_size + 256 * sizeof(ACT_NODE_t *));
+        table = (ACT_NODE_t **) &nod->outgoing[nod->outgoing_size];
+        
+        for (i = 0; i < 256; i++)
+            table[i] = NULL;
+        
+        for (i = 0; i < nod->outgoing_size; i++)
+            table[(unsigned char) nod->outgoing[i].alpha] = 
+                    nod->outgoing[i].next;
+        
+        nod->edge_mode = ACT_EDGE_MODE_DIRECT;
+    }
+    else if (nod->outgoing_size > NODE_LINEAR_MAX_EDGES)
+    {
+        nod->outgoing = (struct act_edge *) realloc (nod->outgoing, 
+                edges_size + sizeof(struct act_edge_bitmap));
+        bm = (struct act_edge_bitmap *) &nod->outgoing[nod->outgoing_size];
+        memset (bm, 0, sizeof(struct act_edge_bitmap));
+        
+        for (i = 0; i < nod->outgoing_size; i++)
+        {
+            key = (unsigned char) nod->outgoing[i].alpha;
+            bm->bits[key >> 5] |= 1U << (key & 31);
+        }
+        
+        for (i = 1; i < 8; i++)
+            bm->rank[i] = bm->rank[i-1] + node_popcount (bm->bits[i-1]);
+        
+        nod->edge_mode = ACT_EDGE_MODE_BITMAP;
+    }
+    else
+    {
+        nod->edge_mode = ACT_EDGE_MODE_LINEAR;
+    }
+}
+
+/**
+ * @brief Counts the set bits
+ * 
+ * @param x
+ * @return 
+ *****************************************************************************/
+static unsigned int node_popcount (unsigned int x)
+{
+#if defined(__GNUC__)
+    return __builtin_popcount (x);
+#else
+    x = x - ((x >> 1) & 0x55555555U);
+    x = (x & 0x33333333U) + ((x >> 2) & 0x33333333U);
+    x = (x + (x >> 4)) & 0x0F0F0F0FU;
+    return (x * 0x01010101U) >> 24;
+#endif
+}
+
 /**
  * @brief Bookmarks the to-be-replaced patterns
  * 
@@ -375,18 +520,20 @@ static void node_grow_outgoing_vector (ACT_NODE_t *thiz)
      * manage different growth rate.
      */
     
-    if (thiz->outgoing_capacity == 0)
+    struct act_node_cold *cold = thiz->cold;
+    
+    if (cold->outgoing_capacity == 0)
     {
-        thiz->outgoing_capacity = grow_factor;
+        cold->outgoing_capacity = grow_factor;
         thiz->outgoing = (struct act_edge *) malloc 
-                (thiz->outgoing_capacity * sizeof(struct act_edge));
+                (cold->outgoing_capacity * sizeof(struct act_edge));
     }
     else
     {
-        thiz->outgoing_capacity += grow_factor;
+        cold->outgoing_capacity += grow_factor;
         thiz->outgoing = (struct act_edge *) realloc (
                 thiz->outgoing, 
-                thiz->outgoing_capacity * sizeof(struct act_edge));
+                cold->outgoing_capacity * sizeof(struct act_edge));
     }
 }
 
@@ -397,18 +544,20 @@ static void node_grow_outgoing_vector (ACT_NODE_t *thiz)
  *****************************************************************************/
 static void node_grow_matched_vector (ACT_NODE_t *thiz)
 {
-    if (thiz->matched_capacity == 0)
+    struct act_node_cold *cold = thiz->cold;
+    
+    if (cold->matched_capacity == 0)
     {
-        thiz->matched_capacity = 1;
+        cold->matched_capacity = 1;
         thiz->matched = (AC_PATTERN_t *) malloc 
-                (thiz->matched_capacity * sizeof(AC_PATTERN_t));
+                (cold->matched_capacity * sizeof(AC_PATTERN_t));
     }
     else
     {
-        thiz->matched_capacity += 2;
+        cold->matched_capacity += 2;
         thiz->matched = (AC_PATTERN_t *) realloc (
                 thiz->matched,
-                thiz->matched_capacity * sizeof(AC_PATTERN_t));
+                cold->matched_capacity * sizeof(AC_PATTERN_t));
     }
 }
 
@@ -416,25 +565,36 @@ static void node_grow_matched_vector (ACT_NODE_t *thiz)
  * @brief Collect accepted patterns of the node.
  * 
  * The accepted patterns consist of the node's own accepted pattern plus 
- * accepted patterns of its failure node.
+ * accepted patterns of its failure node. The nodes must be visited in the 
+ * breadth-first order, so the failure node has already collected the 
+ * patterns of its own failure chain; they are copied at once. The merged 
+ * identifiers of a pattern are not copied; they are linked to it.
  * 
  * @param node
  *****************************************************************************/
 void node_collect_matches (ACT_NODE_t *nod)
 {
-    size_t i;
-    ACT_NODE_t *n = nod;
+    ACT_NODE_t *fail = nod->failure_node;
+    size_t size;
     
-    while ((n = n->failure_node))
+    if (fail && fail->matched_size)
     {
-        for (i = 0; i < n->matched_size; i++)
-            /* Always call with copy parameter 0 */
-            node_accept_pattern (nod, &(n->matched[i]), 0);
+        /* One pattern for every final suffix; it is not more than the 
+         * depth of the node */
+        size = nod->matched_size + fail->matched_size;
+        
+        nod->matched = (AC_PATTERN_t *) realloc (nod->matched, 
+                size * sizeof(AC_PATTERN_t));
+        nod->cold->matched_capacity = size;
         
-        if (n->final)
-            nod->final = 1;
+        memcpy (&nod->matched[nod->matched_size], fail->matched, 
+                fail->matched_size * sizeof(AC_PATTERN_t));
+        nod->matched_size = size;
     }
     
+    if (fail && fail->final)
+        nod->final = 1;
+    
     node_sort_edges (nod);
     /* Sort matched patterns? Is that necessary? I don't think so. */
 }
@@ -449,11 +609,11 @@ void node_display (ACT_NODE_t *nod)
 {
     size_t j;
     struct act_edge *e;
-    AC_PATTERN_t patt;
+    AC_PATTERN_t *patt;
     
-    printf("NODE(%3d)/....fail....> ", nod->id);
+    printf("NODE(%3u)/....fail....> ", nod->cold->id);
     if (nod->failure_node)
-        printf("NODE(%3d)\n", nod->failure_node->id);
+        printf("NODE(%3u)\n", nod->failure_node->cold->id);
     else
         printf ("N.A.\n");
     
@@ -465,7 +625,7 @@ void node_display (ACT_NODE_t *nod)
             printf("%c)---", e->alpha);
         else
             printf("0x%x)", e->alpha);
-        printf("--> NODE(%3d)\n", e->next->id);
+        printf("--> NODE(%3u)\n", e->next->cold->id);
     }
 
     if (nod->matched_size)
@@ -473,20 +633,26 @@ void node_display (ACT_NODE_t *nod)
         printf("Accepts: {");
         for (j = 0; j < nod->matched_size; j++)
         {
-            patt = nod->matched[j];
             if(j) 
                 printf(", ");
-            switch (patt.id.type)
+            /* The merged identifiers of the pattern are separated by '/' */
+            for (patt = &nod->matched[j]; patt; patt = patt->merged)
             {
-            case AC_PATTID_TYPE_DEFAULT:
-            case AC_PATTID_TYPE_NUMBER:
-                printf("%ld", patt.id.u.number);
-                break;
-            case AC_PATTID_TYPE_STRING:
-                printf("%s", patt.id.u.stringy);
-                break;
+                if (patt != &nod->matched[j])
+                    printf("/");
+                switch (patt->id.type)
+                {
+                case AC_PATTID_TYPE_DEFAULT:
+                case AC_PATTID_TYPE_NUMBER:
+                    printf("%ld", patt->id.u.number);
+                    break;
+                case AC_PATTID_TYPE_STRING:
+                    printf("%s", patt->id.u.stringy);
+                    break;
+                }
             }
-            printf(": %.*s", (int)patt.ptext.length, patt.ptext.astring);
+            patt = &nod->matched[j];
+            printf(": %.*s", (int)patt->ptext.length, patt->ptext.astring);
         }
         printf("}\n");
     }
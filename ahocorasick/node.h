@@ -30,33 +30,68 @@ extern "C" {
 /* Forward Declaration */
 struct act_edge;
 struct ac_trie;
+struct mpool;
+
+/**
+ * The cold part of the trie node: data that is needed only while building the
+ * trie or for debugging purpose. The search loop never touches it.
+ */
+struct act_node_cold
+{
+    unsigned int id;    /**< Node identifier: dense per trie, the root is 0 */
+    unsigned int order; /**< Insertion order of the pattern of the node */
+    
+    unsigned short outgoing_capacity;   /**< Max capacity of outgoing edges */
+    unsigned short matched_capacity;    /**< Max capacity of the matched 
+                                         * patterns */
+    AC_PATTERN_t *last_merged;  /**< The last pattern linked to the accepted 
+                                 * pattern; see node_merge_pattern() */
+    
+    struct ac_trie *trie;    /**< The trie that this node belongs to */
+};
+
+/**
+ * How the outgoing edges of a node are looked up after the trie is finalized
+ */
+typedef enum act_edge_mode
+{
+    ACT_EDGE_MODE_LINEAR = 0,   /**< Linear search on a few edges */
+    ACT_EDGE_MODE_BITMAP,       /**< A bitmap of alphas and its rank */
+    ACT_EDGE_MODE_DIRECT        /**< A table of next nodes indexed by alpha */
+} ACT_EDGE_MODE_t;
 
 /**
  * Aho-Corasick Trie node 
+ * 
+ * The node only keeps the fields that the search/replace loops touch; the 
+ * rest is moved to the cold part. The counters use narrow integer types which 
+ * are bounded by the alphabet size and AC_PATTRN_MAX_LENGTH.
  */
 typedef struct act_node
 {
-    int id;     /**< Node identifier: used for debugging purpose */
-    
-    int final;      /**< A final node accepts pattern; 0: not, 1: is final */
-    size_t depth;   /**< Distance between this node and the root */
+    struct act_edge *outgoing;      /**< Outgoing edges array */
     struct act_node *failure_node;  /**< The failure transition node */
     
-    struct act_edge *outgoing;  /**< Outgoing edges array */
-    size_t outgoing_capacity;   /**< Max capacity of outgoing edges */
-    size_t outgoing_size;       /**< Number of outgoing edges */
-    
-    AC_PATTERN_t *matched;      /**< Matched patterns array */
-    size_t matched_capacity;    /**< Max capacity of the matched patterns */
-    size_t matched_size;        /**< Number of matched patterns in this node */
-    
+    AC_PATTERN_t *matched;          /**< Matched patterns array */
     AC_PATTERN_t *to_be_replaced;   /**< Pointer to the pattern that must be 
                                      * replaced */
     
-    struct ac_trie *trie;    /**< The trie that this node belongs to */
+    struct act_node_cold *cold;     /**< Build time and debugging data */
+    
+    unsigned short outgoing_size;   /**< Number of outgoing edges */
+    unsigned short matched_size;    /**< Number of matched patterns in this 
+                                     * node */
+    unsigned short depth;   /**< Distance between this node and the root */
+    unsigned char final;    /**< A final node accepts pattern; 0: not, 
+                             * 1: is final */
+    unsigned char edge_mode;    /**< Edge lookup method; ACT_EDGE_MODE_t */
     
 } ACT_NODE_t;
 
+#if (AC_PATTRN_MAX_LENGTH > 0xFFFF)
+#error "AC_PATTRN_MAX_LENGTH does not fit in the node depth field"
+#endif
+
 /**
  * Edge of the node 
  */
@@ -66,19 +101,37 @@ struct act_edge
     ACT_NODE_t *next;       /**< Target of the edge */
 };
 
+/**
+ * Bitmap of the outgoing alphas of a node. It is stored right after the 
+ * sorted edges array; the rank of an alpha in the bitmap is its edge index.
+ */
+struct act_edge_bitmap
+{
+    unsigned int bits[8];       /**< One bit per alpha */
+    unsigned char rank[8];      /**< Number of edges before each word */
+};
+
 /*
  * Node interface functions
  */
 
 ACT_NODE_t *node_create (struct ac_trie *trie);
+void node_init (ACT_NODE_t *nod, struct act_node_cold *cold, 
+        struct ac_trie *trie);
 ACT_NODE_t *node_create_next (ACT_NODE_t *nod, AC_ALPHABET_t alpha);
 ACT_NODE_t *node_find_next (ACT_NODE_t *nod, AC_ALPHABET_t alpha);
 ACT_NODE_t *node_find_next_bs (ACT_NODE_t *nod, AC_ALPHABET_t alpha);
+ACT_NODE_t *node_find_next_fast (ACT_NODE_t *nod, AC_ALPHABET_t alpha);
 
 void node_assign_id (ACT_NODE_t *nod);
 void node_add_edge (ACT_NODE_t *nod, ACT_NODE_t *next, AC_ALPHABET_t alpha);
 void node_sort_edges (ACT_NODE_t *nod);
+void node_index_edges (ACT_NODE_t *nod);
 void node_accept_pattern (ACT_NODE_t *nod, AC_PATTERN_t *new_patt, int copy);
+void node_merge_pattern (ACT_NODE_t *nod, AC_PATTERN_t *new_patt, int copy);
+void node_link_merged (ACT_NODE_t *nod, AC_PATTERN_t *patt);
+void node_copy_pattern (struct mpool *mp, 
+        AC_PATTERN_t *to, AC_PATTERN_t *from);
 void node_collect_matches (ACT_NODE_t *nod);
 void node_release_vectors (ACT_NODE_t *nod);
 int  node_book_replacement (ACT_NODE_t *nod);
@@ -0,0 +1,118 @@
+/*
+ * parallel.c: Implements a minimal job runner on top of POSIX threads
+ * 
+ * This file is part of multifast.
+ *
+    Copyright 2010-2015 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "parallel.h"
+
+/* The shared state of the workers */
+struct ac_parallel
+{
+    pthread_mutex_t lock;   /* Protects next_job */
+    size_t next_job;        /* The first job that is not taken yet */
+    size_t jobs;            /* Total number of jobs */
+    
+    AC_PARALLEL_JOB_f func; /* The job function */
+    void *param;            /* User parameter of the job function */
+};
+
+/**
+ * @brief The worker loop: takes jobs one by one until no job is left
+ * 
+ * @param arg
+ * @return 
+ *****************************************************************************/
+static void *ac_parallel_worker (void *arg)
+{
+    struct ac_parallel *par = (struct ac_parallel *) arg;
+    size_t job;
+    
+    while (1)
+    {
+        pthread_mutex_lock (&par->lock);
+        job = par->next_job++;
+        pthread_mutex_unlock (&par->lock);
+        
+        if (job >= par->jobs)
+            break;
+        
+        par->func (job, par->param);
+    }
+    
+    return NULL;
+}
+
+/**
+ * @brief Runs the given jobs on a number of threads and returns when all the
+ * jobs are done.
+ * 
+ * Jobs are handed out in their numeric order, so the caller can put the 
+ * heavier jobs first to balance the load. The calling thread works as one of 
+ * the workers. If threads can not be created, the remaining jobs are done 
+ * by the calling thread.
+ * 
+ * @param threads Maximum number of threads
+ * @param jobs Number of jobs
+ * @param func The job function
+ * @param param User parameter that is sent to the job function
+ *****************************************************************************/
+void ac_parallel_run (unsigned int threads, size_t jobs, 
+        AC_PARALLEL_JOB_f func, void *param)
+{
+    struct ac_parallel par;
+    pthread_t *tids;
+    unsigned int i, started = 0;
+    size_t job;
+    
+    if (threads > jobs)
+        threads = jobs;
+    
+    if (threads <= 1)
+    {
+        for (job = 0; job < jobs; job++)
+            func (job, param);
+        return;
+    }
+    
+    par.next_job = 0;
+    par.jobs = jobs;
+    par.func = func;
+    par.param = param;
+    pthread_mutex_init (&par.lock, NULL);
+    
+    tids = (pthread_t *) malloc ((threads - 1) * sizeof(pthread_t));
+    
+    for (i = 0; i < threads - 1; i++)
+    {
+        if (pthread_create (&tids[i], NULL, ac_parallel_worker, &par))
+            break;
+        started++;
+    }
+    
+    ac_parallel_worker (&par);
+    
+    for (i = 0; i < started; i++)
+        pthread_join (tids[i], NULL);
+    
+    free (tids);
+    pthread_mutex_destroy (&par.lock);
+}
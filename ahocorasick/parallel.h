@@ -0,0 +1,45 @@
+/*
+ * parallel.h: Defines a minimal job runner used to spread the work over 
+ * threads
+ * 
+ * This file is part of multifast.
+ *
+    Copyright 2010-2015 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _PARALLEL_H_
+#define	_PARALLEL_H_
+
+#include <stdlib.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/**
+ * The job function; receives the job number and the user parameter
+ */
+typedef void (*AC_PARALLEL_JOB_f)(size_t, void *);
+
+void ac_parallel_run (unsigned int threads, size_t jobs, 
+        AC_PARALLEL_JOB_f func, void *param);
+
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _PARALLEL_H_ */
@@ -19,10 +19,12 @@
     along with multifast.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "node.h"
 #include "ahocorasick.h"
+#include "parallel.h"
 
 
 /* Privates */
@@ -36,21 +38,113 @@ static void mf_repdata_booknominee
 static void mf_repdata_push_nominee 
     (MF_REPLACEMENT_DATA_t *rd, struct mf_replacement_nominee *new_nom);
 
+/**
+ * The output of the one-shot replace functions
+ */
+struct mf_replace_output
+{
+    AC_ALPHABET_t *buffer;  /**< The result */
+    size_t capacity;        /**< Size of the buffer */
+    size_t length;          /**< Length of the result; it may be bigger than 
+                             * capacity if the buffer can not grow */
+    int grow;               /**< Indicates that the buffer is ours and can 
+                             * grow */
+};
+
+static void mf_repdata_collect 
+    (MF_SEGMENT_t *segs, size_t count, void *user);
+
+static int mf_repdata_replace_all (AC_TRIE_t *thiz, AC_TEXT_t *instr, 
+        MF_REPLACE_MODE_t mode, size_t position, 
+        struct mf_replace_output *out);
+
+/**
+ * A region of the input of multifast_replace_parallel()
+ */
+struct mf_replace_region
+{
+    AC_TRIE_t *trie;    /**< The clone of the trie which replaces the region */
+    AC_TEXT_t input;    /**< The region of the input */
+    AC_TEXT_t output;   /**< The replacement result of the region */
+};
+
+/**
+ * The parameter of the parallel replace jobs
+ */
+struct mf_replace_job
+{
+    struct mf_replace_region *regions;  /**< The regions of the round */
+    AC_TEXT_t *text;                    /**< The whole input */
+    MF_REPLACE_MODE_t mode;             /**< The replace mode */
+};
+
+/**
+ * A replacement found by multifast_replace_inplace()
+ */
+struct mf_replace_patch
+{
+    size_t position;    /**< Position of the replacement in the text */
+    AC_TEXT_t text;     /**< The replacement text */
+};
+
+/**
+ * The replacements found by multifast_replace_inplace()
+ */
+struct mf_replace_patches
+{
+    struct mf_replace_patch *patches;   /**< The replacements */
+    size_t size;                        /**< Number of the replacements */
+    size_t capacity;                    /**< Size of the patches array */
+    size_t position;    /**< Length of the replacement result so far */
+    int overlap;        /**< Indicates that the result is not aligned with 
+                         * the input text, because of overlapping 
+                         * replacements */
+};
+
+static void mf_repdata_collect_patches 
+    (MF_SEGMENT_t *segs, size_t count, void *user);
+
+static unsigned int mf_repdata_samelength (ACT_NODE_t *node);
+
+static size_t mf_repdata_safecut 
+    (AC_TRIE_t *thiz, AC_TEXT_t *instr, size_t position);
+
+static void mf_repdata_replace_job (size_t index, void *param);
+
+/* Returns the i-th nominee in the circular queue */
+#define MF_REPDATA_NOMINEE(rd,i) \
+    (&(rd)->noms[((rd)->noms_head + (i)) & ((rd)->noms_capacity - 1)])
+
 static void mf_repdata_grow_noms_array 
     (MF_REPLACEMENT_DATA_t *rd);
 
 static void mf_repdata_appendtext 
-    (MF_REPLACEMENT_DATA_t *rd, AC_TEXT_t *text);
+    (MF_REPLACEMENT_DATA_t *rd, AC_TEXT_t *text, size_t position);
+
+static void mf_repdata_appendsegment 
+    (MF_REPLACEMENT_DATA_t *rd, AC_TEXT_t *text, size_t position);
 
 static void mf_repdata_appendfactor 
     (MF_REPLACEMENT_DATA_t *rd, size_t from, size_t to);
 
+static void mf_repdata_appendproduced 
+    (MF_REPLACEMENT_DATA_t *rd, struct mf_replacement_nominee *nom);
+
+static void mf_repdata_count 
+    (MF_REPLACEMENT_DATA_t *rd, AC_PATTERN_t *pattern);
+
+static struct mf_replacement_count *mf_repdata_findcount 
+    (MF_REPLACEMENT_DATA_t *rd, AC_PATTERN_t *pattern);
+
 static void mf_repdata_savetobacklog 
     (MF_REPLACEMENT_DATA_t *rd, size_t to_position_r);
 
 static void mf_repdata_flush 
     (MF_REPLACEMENT_DATA_t *rd);
 
+static int mf_repdata_replace 
+    (AC_TRIE_t *thiz, AC_TEXT_t *instr, MF_REPLACE_MODE_t mode);
+
 static unsigned int mf_repdata_bookreplacements 
     (ACT_NODE_t *node);
 
@@ -73,15 +167,34 @@ void mf_repdata_init (AC_TRIE_t *trie)
     
     rd->buffer.astring = NULL;
     rd->buffer.length = 0;
+    rd->buffer_size = MF_REPLACEMENT_BUFFER_SIZE;
     rd->backlog.astring = NULL;
     rd->backlog.length = 0;
+    rd->backlog_buffer = NULL;
+    rd->stable_input = 0;
     rd->has_replacement = 0;
+    rd->same_length = 0;
     rd->curser = 0;
     
     rd->noms = NULL;
     rd->noms_capacity = 0;
+    rd->noms_head = 0;
     rd->noms_size = 0;
     
+    rd->cbf = NULL;
+    rd->scbf = NULL;
+    rd->pcbf = NULL;
+    rd->puser = NULL;
+    rd->segs = NULL;
+    rd->segs_capacity = 0;
+    rd->segs_size = 0;
+    
+    rd->dryrun = 0;
+    memset (&rd->stats, 0, sizeof(MF_REPLACE_STATS_t));
+    rd->counts = NULL;
+    rd->counts_capacity = 0;
+    rd->counts_size = 0;
+    
     rd->replace_mode = MF_REPLACE_MODE_DEFAULT;
     rd->trie = trie;
 }
@@ -94,16 +207,22 @@ void mf_repdata_init (AC_TRIE_t *trie)
  *****************************************************************************/
 void mf_repdata_allocbuf (MF_REPLACEMENT_DATA_t *rd)
 {    
-    /* Bookmark replacement pattern for faster retrieval */
-    rd->has_replacement = mf_repdata_bookreplacements (rd->trie->root);
+    /* Bookmark replacement pattern for faster retrieval; the clones of a 
+     * trie share the bookmarks of the original trie */
+    if (!rd->trie->shared)
+    {
+        rd->has_replacement = mf_repdata_bookreplacements (rd->trie->root);
+        rd->same_length = mf_repdata_samelength (rd->trie->root);
+    }
     
     if (rd->has_replacement)
     {
         rd->buffer.astring = (AC_ALPHABET_t *) 
-                malloc (MF_REPLACEMENT_BUFFER_SIZE * sizeof(AC_ALPHABET_t));
+                malloc (rd->buffer_size * sizeof(AC_ALPHABET_t));
         
-        rd->backlog.astring = (AC_ALPHABET_t *) 
+        rd->backlog_buffer = (AC_ALPHABET_t *) 
                 malloc (AC_PATTRN_MAX_LENGTH * sizeof(AC_ALPHABET_t));
+        rd->backlog.astring = rd->backlog_buffer;
         
         /* Backlog length is not bigger than the max pattern length */
     }
@@ -131,6 +250,30 @@ static unsigned int mf_repdata_bookreplacements (ACT_NODE_t *node)
     return ret;
 }
 
+/**
+ * @brief Checks that the to-be-replaced patterns of the sub-trie have 
+ * replacements of the same length
+ * 
+ * @param node the root of the sub-trie
+ * @return 1 if the lengths are the same, 0 otherwise
+ *****************************************************************************/
+static unsigned int mf_repdata_samelength (ACT_NODE_t *node)
+{
+    size_t i;
+    AC_PATTERN_t *pattern = node->to_be_replaced;
+    
+    if (pattern && pattern->rtext.length != pattern->ptext.length)
+        return 0;
+    
+    for (i = 0; i < node->outgoing_size; i++)
+    {
+        if (!mf_repdata_samelength (node->outgoing[i].next))
+            return 0;
+    }
+    
+    return 1;
+}
+
 /**
  * @brief Resets the replacement data and prepares it for a new operation
  * 
@@ -141,7 +284,9 @@ void mf_repdata_reset (MF_REPLACEMENT_DATA_t *rd)
     rd->buffer.length = 0;
     rd->backlog.length = 0;
     rd->curser = 0;
+    rd->noms_head = 0;
     rd->noms_size = 0;
+    rd->segs_size = 0;
 }
 
 /**
@@ -152,8 +297,10 @@ void mf_repdata_reset (MF_REPLACEMENT_DATA_t *rd)
 void mf_repdata_release (MF_REPLACEMENT_DATA_t *rd)
 {    
     free((AC_ALPHABET_t *)rd->buffer.astring);
-    free((AC_ALPHABET_t *)rd->backlog.astring);
+    free(rd->backlog_buffer);
     free(rd->noms);
+    free(rd->segs);
+    free(rd->counts);
 }
 
 /**
@@ -163,31 +310,58 @@ void mf_repdata_release (MF_REPLACEMENT_DATA_t *rd)
  *****************************************************************************/
 static void mf_repdata_flush (MF_REPLACEMENT_DATA_t *rd)
 {    
+    if (rd->scbf)
+    {
+        if (rd->segs_size)
+            rd->scbf(rd->segs, rd->segs_size, rd->user);
+        rd->segs_size = 0;
+        rd->buffer.length = 0; /* The produced replacements are given too */
+        return;
+    }
+    
     rd->cbf(&rd->buffer, rd->user);
     rd->buffer.length = 0;
 }
 
 /**
- * @brief Extends the nominees array
+ * @brief Extends the nominees array. The capacity is doubled and the queue 
+ * is unrolled to the beginning of the new array.
  * 
  * @param rd
  *****************************************************************************/
 static void mf_repdata_grow_noms_array (MF_REPLACEMENT_DATA_t *rd)
 {
-    const size_t grow_factor = 128;
+    const size_t initial_capacity = 128;
+    struct mf_replacement_nominee *noms;
+    size_t first_part;
     
     if (rd->noms_capacity == 0)
     {
-        rd->noms_capacity = grow_factor;
+        rd->noms_capacity = initial_capacity;
         rd->noms = (struct mf_replacement_nominee *) malloc 
                 (rd->noms_capacity * sizeof(struct mf_replacement_nominee));
+        rd->noms_head = 0;
         rd->noms_size = 0;
     }
     else
     {
-        rd->noms_capacity += grow_factor;
-        rd->noms = (struct mf_replacement_nominee *) realloc (rd->noms, 
-                rd->noms_capacity * sizeof(struct mf_replacement_nominee));
+        noms = (struct mf_replacement_nominee *) malloc 
+                (2 * rd->noms_capacity * sizeof(struct mf_replacement_nominee));
+        
+        /* The part from head to the end of the array, then the wrapped part */
+        first_part = rd->noms_capacity - rd->noms_head;
+        if (first_part > rd->noms_size)
+            first_part = rd->noms_size;
+        
+        memcpy (noms, &rd->noms[rd->noms_head], 
+                first_part * sizeof(struct mf_replacement_nominee));
+        memcpy (&noms[first_part], rd->noms, (rd->noms_size - first_part) * 
+                sizeof(struct mf_replacement_nominee));
+        
+        free (rd->noms);
+        rd->noms = noms;
+        rd->noms_capacity *= 2;
+        rd->noms_head = 0;
     }
 }
 
@@ -207,7 +381,7 @@ static void mf_repdata_push_nominee
         mf_repdata_grow_noms_array (rd);
     
     /* Add the new nominee to the end */
-    nomp = &rd->noms[rd->noms_size];
+    nomp = MF_REPDATA_NOMINEE(rd, rd->noms_size);
     nomp->pattern = new_nom->pattern;
     nomp->position = new_nom->position;
     rd->noms_size ++;
@@ -240,7 +414,7 @@ static void mf_repdata_booknominee (MF_REPLACEMENT_DATA_t *rd,
             
             if (rd->noms_size > 0)
             {
-                prev_nom = &rd->noms[rd->noms_size - 1];
+                prev_nom = MF_REPDATA_NOMINEE(rd, rd->noms_size - 1);
                 prev_end_pos = prev_nom->position;
 
                 if (new_start_pos < prev_end_pos)
@@ -254,7 +428,7 @@ static void mf_repdata_booknominee (MF_REPLACEMENT_DATA_t *rd,
             
             while (rd->noms_size > 0)
             {
-                prev_nom = &rd->noms[rd->noms_size - 1];
+                prev_nom = MF_REPDATA_NOMINEE(rd, rd->noms_size - 1);
                 prev_start_pos = 
                         prev_nom->position - prev_nom->pattern->ptext.length;
                 prev_end_pos = prev_nom->position;
@@ -276,17 +450,26 @@ static void mf_repdata_booknominee (MF_REPLACEMENT_DATA_t *rd,
  * 
  * @param rd
  * @param text
+ * @param position position of the text in the whole input, or 
+ * MF_SEGMENT_NOT_INPUT
  *****************************************************************************/
-static void mf_repdata_appendtext (MF_REPLACEMENT_DATA_t *rd, AC_TEXT_t *text)
+static void mf_repdata_appendtext 
+    (MF_REPLACEMENT_DATA_t *rd, AC_TEXT_t *text, size_t position)
 {
     size_t remaining_bufspace = 0;
     size_t remaining_text = 0;
     size_t copy_len = 0;
     size_t copy_index = 0;
     
+    if (rd->scbf)
+    {
+        mf_repdata_appendsegment (rd, text, position);
+        return;
+    }
+    
     while (copy_index < text->length)
     {
-        remaining_bufspace = MF_REPLACEMENT_BUFFER_SIZE - rd->buffer.length;
+        remaining_bufspace = rd->buffer_size - rd->buffer.length;
         remaining_text = text->length - copy_index;
         
         copy_len = (remaining_bufspace >= remaining_text)? 
@@ -299,11 +482,166 @@ static void mf_repdata_appendtext (MF_REPLACEMENT_DATA_t *rd, AC_TEXT_t *text)
         rd->buffer.length += copy_len;
         copy_index += copy_len;
         
-        if (rd->buffer.length == MF_REPLACEMENT_BUFFER_SIZE)
+        if (rd->buffer.length == rd->buffer_size)
             mf_repdata_flush(rd);
     }
 }
 
+/**
+ * @brief Append the given text to the segments array without copying it. A 
+ * segment which continues the last one is merged with it.
+ * 
+ * @param rd
+ * @param text
+ * @param position position of the text in the whole input, or 
+ * MF_SEGMENT_NOT_INPUT
+ *****************************************************************************/
+static void mf_repdata_appendsegment 
+    (MF_REPLACEMENT_DATA_t *rd, AC_TEXT_t *text, size_t position)
+{
+    MF_SEGMENT_t *seg;
+    
+    if (text->length == 0)
+        return;
+    
+    if (rd->segs_size)
+    {
+        seg = &rd->segs[rd->segs_size - 1];
+        
+        if (seg->text.astring + seg->text.length == text->astring && 
+                (position == MF_SEGMENT_NOT_INPUT ? 
+                seg->position == MF_SEGMENT_NOT_INPUT : 
+                seg->position + seg->text.length == position))
+        {
+            seg->text.length += text->length;
+            return;
+        }
+    }
+    
+    if (rd->segs_size == rd->segs_capacity)
+    {
+        rd->segs_capacity = rd->segs_capacity ? 2 * rd->segs_capacity : 64;
+        rd->segs = (MF_SEGMENT_t *) realloc 
+                (rd->segs, rd->segs_capacity * sizeof(MF_SEGMENT_t));
+    }
+    
+    seg = &rd->segs[rd->segs_size++];
+    seg->text = *text;
+    seg->position = position;
+}
+
+/**
+ * @brief Append the replacement produced by the pattern call-back function. 
+ * It is written directly to the replacement buffer; in segment mode the 
+ * buffer keeps the produced replacements until the segments are flushed.
+ * 
+ * @param rd
+ * @param nom the replacement nominee
+ *****************************************************************************/
+static void mf_repdata_appendproduced 
+    (MF_REPLACEMENT_DATA_t *rd, struct mf_replacement_nominee *nom)
+{
+    AC_TEXT_t text;
+    size_t size;
+    
+    /* Give at least AC_PATTRN_MAX_LENGTH space to the call-back function */
+    if (rd->buffer_size - rd->buffer.length < AC_PATTRN_MAX_LENGTH)
+        mf_repdata_flush (rd);
+    
+    size = rd->buffer_size - rd->buffer.length;
+    
+    text.astring = &rd->buffer.astring[rd->buffer.length];
+    text.length = rd->pcbf (nom->pattern, 
+            nom->position - nom->pattern->ptext.length, 
+            (AC_ALPHABET_t *) text.astring, size, rd->puser);
+    
+    if (text.length > size)
+        text.length = size;
+    
+    rd->buffer.length += text.length;
+    
+    if (rd->scbf)
+        mf_repdata_appendsegment (rd, &text, MF_SEGMENT_NOT_INPUT);
+    else if (rd->buffer.length == rd->buffer_size)
+        mf_repdata_flush (rd);
+}
+
+/**
+ * @brief Counts a replacement of the pattern in dry-run
+ * 
+ * @param rd
+ * @param pattern
+ *****************************************************************************/
+static void mf_repdata_count (MF_REPLACEMENT_DATA_t *rd, AC_PATTERN_t *pattern)
+{
+    struct mf_replacement_count *old_counts;
+    size_t old_capacity, i;
+    
+    rd->stats.replacements++;
+    rd->stats.output_length += pattern->rtext.length;
+    
+    if (2 * (rd->counts_size + 1) > rd->counts_capacity)
+    {
+        /* Grow the hash table and move the entries to the new one */
+        old_counts = rd->counts;
+        old_capacity = rd->counts_capacity;
+        
+        rd->counts_capacity = old_capacity ? 2 * old_capacity : 64;
+        rd->counts = (struct mf_replacement_count *) calloc 
+                (rd->counts_capacity, sizeof(struct mf_replacement_count));
+        rd->counts_size = 0;
+        
+        for (i = 0; i < old_capacity; i++)
+        {
+            if (old_counts[i].pattern)
+                *mf_repdata_findcount (rd, old_counts[i].pattern) = 
+                        old_counts[i];
+        }
+        
+        free (old_counts);
+    }
+    
+    mf_repdata_findcount (rd, pattern)->count++;
+}
+
+/**
+ * @brief Finds the count of the pattern in the hash table, or adds it. The 
+ * copies of a pattern in different nodes share the pattern string, so the 
+ * string identifies the pattern.
+ * 
+ * @param rd
+ * @param pattern
+ * @return the count entry
+ *****************************************************************************/
+static struct mf_replacement_count *mf_repdata_findcount 
+    (MF_REPLACEMENT_DATA_t *rd, AC_PATTERN_t *pattern)
+{
+    struct mf_replacement_count *entry;
+    size_t i, hash;
+    
+    hash = ((size_t) pattern->ptext.astring >> 3) ^ 
+            (pattern->ptext.length * 0x9E3779B9UL);
+    hash ^= hash >> 16;
+    
+    for (i = hash & (rd->counts_capacity - 1); ; 
+            i = (i + 1) & (rd->counts_capacity - 1))
+    {
+        entry = &rd->counts[i];
+        
+        if (!entry->pattern)
+        {
+            entry->pattern = pattern;
+            entry->count = 0;
+            rd->counts_size++;
+            return entry;
+        }
+        
+        if (entry->pattern->ptext.astring == pattern->ptext.astring && 
+                entry->pattern->ptext.length == pattern->ptext.length)
+            return entry;
+    }
+}
+
 /**
  * @brief Append a factor of the current text to the output buffer
  *  
@@ -322,12 +660,18 @@ static void mf_repdata_appendfactor
     if (to < from)
         return;
     
+    if (rd->dryrun)
+    {
+        rd->stats.output_length += to - from;
+        return;
+    }
+    
     if (base_position <= from)
     {
         /* The backlog located in the input text part */
         factor.astring = &instr->astring[from - base_position];
         factor.length = to - from;
-        mf_repdata_appendtext(rd, &factor);
+        mf_repdata_appendtext(rd, &factor, from);
     }
     else
     {
@@ -340,7 +684,7 @@ static void mf_repdata_appendfactor
             /* The backlog located in the backlog part */
             factor.astring = &rd->backlog.astring[from - backlog_base_pos];
             factor.length = to - from;
-            mf_repdata_appendtext (rd, &factor);
+            mf_repdata_appendtext (rd, &factor, from);
         }
         else
         {
@@ -349,12 +693,12 @@ static void mf_repdata_appendfactor
             /* The backlog part */
             factor.astring = &rd->backlog.astring[from - backlog_base_pos];
             factor.length = rd->backlog.length - from + backlog_base_pos;
-            mf_repdata_appendtext (rd, &factor);
+            mf_repdata_appendtext (rd, &factor, from);
             
             /* The input text part */
             factor.astring = instr->astring;
             factor.length = to - base_position;
-            mf_repdata_appendtext (rd, &factor);
+            mf_repdata_appendtext (rd, &factor, base_position);
         }
     }
 }
@@ -370,6 +714,8 @@ static void mf_repdata_savetobacklog (MF_REPLACEMENT_DATA_t *rd, size_t bg_pos)
 {
     size_t bg_pos_r; /* relative backlog position */
     AC_TEXT_t *instr = rd->trie->text;
+    const AC_ALPHABET_t *tail;
+    size_t tail_length;
     size_t base_position = rd->trie->base_position;
     
     if (base_position < bg_pos)
@@ -383,13 +729,31 @@ static void mf_repdata_savetobacklog (MF_REPLACEMENT_DATA_t *rd, size_t bg_pos)
     if (instr->length < bg_pos_r)
         return; /* unexpected : assert (instr->length >= bg_pos_r) */
     
+    tail = &instr->astring[bg_pos_r];
+    tail_length = instr->length - bg_pos_r;
+    
+    if (rd->stable_input && rd->backlog.length == 0)
+    {
+        /* The input stays valid until the next call; refer to it instead of 
+         * copying it. A backlog which refers to the previous chunk is never 
+         * extended, even if the chunks are adjacent in the memory; the 
+         * previous chunk may be overwritten after this call */
+        rd->backlog.astring = tail;
+        rd->backlog.length = tail_length;
+        return;
+    }
+    
+    if (rd->backlog.astring != rd->backlog_buffer)
+    {
+        /* Move the referred backlog to the backlog buffer */
+        memcpy (rd->backlog_buffer, rd->backlog.astring, rd->backlog.length);
+        rd->backlog.astring = rd->backlog_buffer;
+    }
+    
     /* Copy the part after bg_pos_r to the backlog buffer */
-    memcpy( (AC_ALPHABET_t *)
-            &rd->backlog.astring[rd->backlog.length], 
-            &instr->astring[bg_pos_r], 
-            instr->length - bg_pos_r );
-
-    rd->backlog.length += instr->length - bg_pos_r;
+    memcpy (&rd->backlog_buffer[rd->backlog.length], tail, tail_length);
+    
+    rd->backlog.length += tail_length;
 }
 
 /**
@@ -403,11 +767,13 @@ static void mf_repdata_savetobacklog (MF_REPLACEMENT_DATA_t *rd, size_t bg_pos)
 static void mf_repdata_do_replace 
     (MF_REPLACEMENT_DATA_t *rd, size_t to_position)
 {
-    unsigned int index;
+    size_t index;
     struct mf_replacement_nominee *nom;
     size_t base_position = rd->trie->base_position;
+    size_t backlog_base_pos = base_position - rd->backlog.length;
+    size_t consumed;
     
-    if (to_position < base_position)
+    if (to_position < rd->curser)
         return;
     
     /* Replace the candidate patterns */
@@ -415,7 +781,7 @@ static void mf_repdata_do_replace
     {
         for (index = 0; index < rd->noms_size; index++)
         {
-            nom = &rd->noms[index];
+            nom = MF_REPDATA_NOMINEE(rd, index);
             
             if (to_position <= (nom->position - nom->pattern->ptext.length))
                 break;
@@ -425,19 +791,20 @@ static void mf_repdata_do_replace
                     nom->position - nom->pattern->ptext.length /* to */);
             
             /* Append the replacement instead of the pattern */
-            mf_repdata_appendtext(rd, &nom->pattern->rtext);
+            if (rd->dryrun)
+                mf_repdata_count (rd, nom->pattern);
+            else if (rd->pcbf)
+                mf_repdata_appendproduced (rd, nom);
+            else
+                mf_repdata_appendtext(rd, &nom->pattern->rtext, 
+                        MF_SEGMENT_NOT_INPUT);
             
             rd->curser = nom->position;
         }
-        rd->noms_size -= index;
         
-        /* Shift the array to the left to eliminate the consumed nominees */
-        if (rd->noms_size && index)
-        {
-            memcpy (&rd->noms[0], &rd->noms[index], 
-                    rd->noms_size * sizeof(struct mf_replacement_nominee));
-            /* TODO: implement a circular queue */
-        }
+        /* Eliminate the consumed nominees from the front of the queue */
+        rd->noms_head = (rd->noms_head + index) & (rd->noms_capacity - 1);
+        rd->noms_size -= index;
     }
     
     /* Append the chunk between the last pattern and to_position */
@@ -448,11 +815,30 @@ static void mf_repdata_do_replace
         rd->curser = to_position;
     }
     
+    if (rd->scbf)
+        /* The segments point to the input text and the backlog; they must 
+         * be given to the user before the backlog changes */
+        mf_repdata_flush (rd);
+    
     if (base_position <= rd->curser)
     {
-        /* we consume the whole backlog or none of it */
+        /* The whole backlog is consumed */
         rd->backlog.length = 0;
     }
+    else if (backlog_base_pos < rd->curser)
+    {
+        /* Drop the consumed front of the backlog; otherwise it grows with 
+         * every chunk shorter than the pending pattern prefix */
+        consumed = rd->curser - backlog_base_pos;
+        
+        if (rd->backlog.astring == rd->backlog_buffer)
+            memmove (rd->backlog_buffer, &rd->backlog_buffer[consumed], 
+                    rd->backlog.length - consumed);
+        else
+            rd->backlog.astring += consumed;
+        
+        rd->backlog.length -= consumed;
+    }
 }
 
 /**
@@ -468,6 +854,584 @@ static void mf_repdata_do_replace
  *****************************************************************************/
 int multifast_replace (AC_TRIE_t *thiz, AC_TEXT_t *instr, 
         MF_REPLACE_MODE_t mode, MF_REPLACE_CALBACK_f callback, void *param)
+{
+    MF_REPLACEMENT_DATA_t *rd = &thiz->repdata;
+    
+    rd->cbf = callback;
+    rd->scbf = NULL;
+    rd->user = param;
+    rd->dryrun = 0;
+    
+    return mf_repdata_replace (thiz, instr, mode);
+}
+
+/**
+ * @brief Replaces the patterns in the given text with their correspondence
+ * replacement in the A.C. Trie. The result is not copied to the replacement 
+ * buffer; it is given to the call-back function as segments that point to 
+ * the input text, the backlog and the replacement texts. It is useful when 
+ * there are few replacements in a big input.
+ * 
+ * The call-back function is called once at the end of every call to this 
+ * function and to multifast_rep_flush(), if there is any result.
+ * 
+ * @param thiz
+ * @param instr
+ * @param mode
+ * @param callback
+ * @param param
+ * @return 
+ *****************************************************************************/
+int multifast_replace_iov (AC_TRIE_t *thiz, AC_TEXT_t *instr, 
+        MF_REPLACE_MODE_t mode, MF_REPLACE_SEGMENT_CALBACK_f callback, 
+        void *param)
+{
+    MF_REPLACEMENT_DATA_t *rd = &thiz->repdata;
+    
+    rd->cbf = NULL;
+    rd->scbf = callback;
+    rd->user = param;
+    rd->dryrun = 0;
+    
+    return mf_repdata_replace (thiz, instr, mode);
+}
+
+/**
+ * @brief Performs a dry-run replacement on the given chunk: the replacements 
+ * are found like multifast_replace() does in the given mode, but no output is
+ * made. Only the replacements of every pattern and the output length are 
+ * counted. After the last chunk, multifast_rep_stats() must be called instead
+ * of multifast_rep_flush().
+ * 
+ * If a replacement call-back function is set, it is not called; the output 
+ * length is counted using the fixed replacement texts.
+ * 
+ * @param thiz
+ * @param instr
+ * @param mode
+ * @return 0 on success; -1 and -2 like multifast_replace()
+ *****************************************************************************/
+int multifast_replace_dryrun (AC_TRIE_t *thiz, AC_TEXT_t *instr, 
+        MF_REPLACE_MODE_t mode)
+{
+    MF_REPLACEMENT_DATA_t *rd = &thiz->repdata;
+    
+    rd->cbf = NULL;
+    rd->scbf = NULL;
+    rd->dryrun = 1;
+    
+    return mf_repdata_replace (thiz, instr, mode);
+}
+
+/**
+ * @brief Ends the dry-run replacement and gives its result. The call-back 
+ * function is called once for every replaced pattern.
+ * 
+ * @param thiz
+ * @param stats receives the total numbers; can be NULL
+ * @param callback receives the replacement count of every pattern; can be 
+ * NULL
+ * @param param the last parameter of the call-back function
+ *****************************************************************************/
+void multifast_rep_stats (AC_TRIE_t *thiz, MF_REPLACE_STATS_t *stats, 
+        MF_REPLACE_COUNT_CALBACK_f callback, void *param)
+{
+    MF_REPLACEMENT_DATA_t *rd = &thiz->repdata;
+    size_t i;
+    
+    /* Count the rest of the input */
+    if (rd->dryrun)
+        mf_repdata_do_replace (rd, thiz->base_position);
+    
+    rd->stats.input_length = thiz->base_position;
+    
+    if (stats)
+        *stats = rd->stats;
+    
+    for (i = 0; i < rd->counts_capacity; i++)
+    {
+        if (!rd->counts[i].pattern)
+            continue;
+        
+        if (callback)
+            callback (rd->counts[i].pattern, rd->counts[i].count, param);
+        
+        rd->counts[i].pattern = NULL;
+    }
+    
+    /* Get ready for the next operation */
+    rd->counts_size = 0;
+    memset (&rd->stats, 0, sizeof(MF_REPLACE_STATS_t));
+    rd->dryrun = 0;
+    
+    mf_repdata_reset (rd);
+    thiz->last_node = thiz->root;
+    thiz->base_position = 0;
+}
+
+/**
+ * @brief Replaces the patterns in the whole given text and returns the 
+ * result in a single buffer. Unlike multifast_replace() there is no 
+ * call-back function and no need to call multifast_rep_flush().
+ * 
+ * @param thiz
+ * @param instr the whole input text
+ * @param mode
+ * @param result receives the result; the string is allocated by malloc() 
+ * and must be freed by the caller
+ * @return 0 on success; -1 and -2 like multifast_replace()
+ *****************************************************************************/
+int multifast_replace_buffer (AC_TRIE_t *thiz, AC_TEXT_t *instr, 
+        MF_REPLACE_MODE_t mode, AC_TEXT_t *result)
+{
+    struct mf_replace_output out;
+    int ret;
+    
+    /* The result is usually about the size of the input */
+    out.capacity = instr->length + (instr->length >> 3) + 64;
+    out.buffer = (AC_ALPHABET_t *) malloc 
+            (out.capacity * sizeof(AC_ALPHABET_t));
+    out.length = 0;
+    out.grow = 1;
+    
+    if ((ret = mf_repdata_replace_all (thiz, instr, mode, 0, &out)))
+    {
+        free (out.buffer);
+        out.buffer = NULL;
+        out.length = 0;
+    }
+    
+    result->astring = out.buffer;
+    result->length = out.length;
+    
+    return ret;
+}
+
+/**
+ * @brief Replaces the patterns in the whole given text and writes the result 
+ * into the given buffer.
+ * 
+ * @param thiz
+ * @param instr the whole input text
+ * @param mode
+ * @param buffer the output buffer
+ * @param size size of the output buffer
+ * @param length receives the length of the result. If the buffer is too 
+ * small, it receives the needed size.
+ * @return 0 on success; -1 and -2 like multifast_replace(); -3 if the buffer 
+ * is too small
+ *****************************************************************************/
+int multifast_replace_into (AC_TRIE_t *thiz, AC_TEXT_t *instr, 
+        MF_REPLACE_MODE_t mode, AC_ALPHABET_t *buffer, size_t size, 
+        size_t *length)
+{
+    struct mf_replace_output out;
+    int ret;
+    
+    out.buffer = buffer;
+    out.capacity = size;
+    out.length = 0;
+    out.grow = 0;
+    
+    ret = mf_repdata_replace_all (thiz, instr, mode, 0, &out);
+    *length = out.length;
+    
+    if (!ret && out.length > size)
+        return -3;
+    
+    return ret;
+}
+
+/**
+ * @brief Replaces the patterns in the given text in place. It only works if 
+ * every replacement has the same length as its pattern; the trie checks that
+ * at finalize (see repdata.same_length).
+ * 
+ * The whole text is searched first, and then the replacements are written 
+ * to the text. Replacements which are the same as the original text are not
+ * written, so the untouched pages of a mapped file are not written back.
+ * 
+ * @param thiz
+ * @param text the whole text; it must be writable
+ * @param length length of the text
+ * @param mode
+ * @return 0 on success; -1 and -2 like multifast_replace(); -3 if the 
+ * replacements are not of the same length as their patterns; -4 if the 
+ * replacements overlap (it can only happen in normal mode). The text is not 
+ * changed if the return value is not 0.
+ *****************************************************************************/
+int multifast_replace_inplace (AC_TRIE_t *thiz, AC_ALPHABET_t *text, 
+        size_t length, MF_REPLACE_MODE_t mode)
+{
+    MF_REPLACEMENT_DATA_t *rd = &thiz->repdata;
+    struct mf_replace_patches pp;
+    struct mf_replace_patch *patch;
+    AC_TEXT_t instr;
+    size_t i;
+    int ret;
+    
+    if (thiz->trie_open)
+        return -1; /* _finalize() must be called first */
+    
+    if (!rd->has_replacement)
+        return -2; /* Trie doesn't have any to-be-replaced pattern */
+    
+    if (!rd->same_length || rd->pcbf)
+        return -3;
+    
+    pp.patches = NULL;
+    pp.size = 0;
+    pp.capacity = 0;
+    pp.position = 0;
+    pp.overlap = 0;
+    
+    instr.astring = text;
+    instr.length = length;
+    
+    /* Find the replacements; the text must not change while searching it */
+    mf_repdata_reset (rd);
+    thiz->last_node = thiz->root;
+    thiz->base_position = 0;
+    
+    rd->cbf = NULL;
+    rd->scbf = mf_repdata_collect_patches;
+    rd->user = &pp;
+    rd->dryrun = 0;
+    
+    mf_repdata_replace (thiz, &instr, mode);
+    multifast_rep_flush (thiz, 0);
+    
+    if (pp.overlap || pp.position != length)
+    {
+        ret = -4;
+    }
+    else
+    {
+        /* Write the replacements */
+        for (i = 0; i < pp.size; i++)
+        {
+            patch = &pp.patches[i];
+            
+            if (memcmp (&text[patch->position], patch->text.astring, 
+                    patch->text.length * sizeof(AC_ALPHABET_t)))
+                memcpy (&text[patch->position], patch->text.astring, 
+                        patch->text.length * sizeof(AC_ALPHABET_t));
+        }
+        ret = 0;
+    }
+    
+    free (pp.patches);
+    
+    return ret;
+}
+
+/**
+ * @brief Collects the replacements of multifast_replace_inplace(). In place
+ * replacement is only possible if every piece of the input text comes out 
+ * at its own position.
+ * 
+ * @param segs
+ * @param count
+ * @param user the patches
+ *****************************************************************************/
+static void mf_repdata_collect_patches 
+    (MF_SEGMENT_t *segs, size_t count, void *user)
+{
+    struct mf_replace_patches *pp = (struct mf_replace_patches *) user;
+    size_t i;
+    
+    for (i = 0; i < count; i++)
+    {
+        if (segs[i].position == MF_SEGMENT_NOT_INPUT)
+        {
+            if (pp->size == pp->capacity)
+            {
+                pp->capacity = pp->capacity ? 2 * pp->capacity : 64;
+                pp->patches = (struct mf_replace_patch *) realloc 
+                        (pp->patches, 
+                        pp->capacity * sizeof(struct mf_replace_patch));
+            }
+            
+            pp->patches[pp->size].position = pp->position;
+            pp->patches[pp->size].text = segs[i].text;
+            pp->size++;
+        }
+        else if (segs[i].position != pp->position)
+        {
+            pp->overlap = 1;
+        }
+        
+        pp->position += segs[i].text.length;
+    }
+}
+
+/**
+ * @brief Replaces the patterns in the whole given text using several threads.
+ * 
+ * The text is cut into regions of about MF_PARALLEL_REGION_SIZE; every cut 
+ * is moved forward until no to-be-replaced pattern crosses it. So the 
+ * regions can be replaced separately and the result is the same as the 
+ * result of multifast_replace() in both normal and lazy modes. Every round 
+ * replaces one region per thread; then the results of the round are given 
+ * to the call-back function in order, one call per region. There is no 
+ * need to call multifast_rep_flush().
+ * 
+ * @param thiz
+ * @param instr the whole input text
+ * @param mode
+ * @param threads number of threads
+ * @param callback
+ * @param param
+ * @return 0 on success; -1 and -2 like multifast_replace()
+ *****************************************************************************/
+int multifast_replace_parallel (AC_TRIE_t *thiz, AC_TEXT_t *instr, 
+        MF_REPLACE_MODE_t mode, unsigned int threads, 
+        MF_REPLACE_CALBACK_f callback, void *param)
+{
+    struct mf_replace_region *regions;
+    struct mf_replace_job job;
+    size_t position, end, count, i;
+    int ret;
+    
+    if (thiz->trie_open)
+        return -1; /* _finalize() must be called first */
+    
+    if (!thiz->repdata.has_replacement)
+        return -2; /* Trie doesn't have any to-be-replaced pattern */
+    
+    if (threads <= 1 || instr->length < 2 * MF_PARALLEL_REGION_SIZE)
+    {
+        /* Not worth the threads; start from a clean state and replace 
+         * in one chunk */
+        mf_repdata_reset (&thiz->repdata);
+        thiz->last_node = thiz->root;
+        thiz->base_position = 0;
+        
+        if ((ret = multifast_replace (thiz, instr, mode, callback, param)))
+            return ret;
+        
+        multifast_rep_flush (thiz, 0);
+        return 0;
+    }
+    
+    regions = (struct mf_replace_region *) 
+            malloc (threads * sizeof(struct mf_replace_region));
+    
+    for (i = 0; i < threads; i++)
+        regions[i].trie = ac_trie_clone (thiz);
+    
+    job.regions = regions;
+    job.text = instr;
+    job.mode = mode;
+    
+    position = 0;
+    
+    while (position < instr->length)
+    {
+        /* Cut the regions of the next round */
+        for (count = 0; count < threads && position < instr->length; count++)
+        {
+            end = position + MF_PARALLEL_REGION_SIZE;
+            
+            if (end < instr->length)
+                end = mf_repdata_safecut (thiz, instr, end);
+            else
+                end = instr->length;
+            
+            regions[count].input.astring = &instr->astring[position];
+            regions[count].input.length = end - position;
+            position = end;
+        }
+        
+        ac_parallel_run (threads, count, mf_repdata_replace_job, &job);
+        
+        /* Give the results to the user in order */
+        for (i = 0; i < count; i++)
+        {
+            if (regions[i].output.length)
+                callback (&regions[i].output, param);
+            
+            free ((AC_ALPHABET_t *) regions[i].output.astring);
+        }
+    }
+    
+    for (i = 0; i < threads; i++)
+        ac_trie_release (regions[i].trie);
+    
+    free (regions);
+    
+    return 0;
+}
+
+/**
+ * @brief Replaces one region of multifast_replace_parallel()
+ * 
+ * @param index the region number in the round
+ * @param param
+ *****************************************************************************/
+static void mf_repdata_replace_job (size_t index, void *param)
+{
+    struct mf_replace_job *job = (struct mf_replace_job *) param;
+    struct mf_replace_region *region = &job->regions[index];
+    struct mf_replace_output out;
+    
+    out.capacity = region->input.length + (region->input.length >> 3) + 64;
+    out.buffer = (AC_ALPHABET_t *) malloc 
+            (out.capacity * sizeof(AC_ALPHABET_t));
+    out.length = 0;
+    out.grow = 1;
+    
+    /* The positions given to the pattern call-back function are in the 
+     * whole input */
+    mf_repdata_replace_all (region->trie, &region->input, job->mode, 
+            region->input.astring - job->text->astring, &out);
+    
+    region->output.astring = out.buffer;
+    region->output.length = out.length;
+}
+
+/**
+ * @brief Finds the first position at or after the given position that is not
+ * inside any to-be-replaced pattern. The text can be cut there and the two 
+ * sides can be replaced separately.
+ * 
+ * @param thiz
+ * @param instr the whole input text
+ * @param position
+ * @return the cut position
+ *****************************************************************************/
+static size_t mf_repdata_safecut 
+    (AC_TRIE_t *thiz, AC_TEXT_t *instr, size_t position)
+{
+    ACT_NODE_t *current = thiz->root;
+    ACT_NODE_t *next;
+    size_t position_r, start;
+    size_t cut = position;
+    
+    /* No pattern is longer than AC_PATTRN_MAX_LENGTH; so starting from here
+     * the automata is in the right state when it arrives at the position */
+    position_r = (position > AC_PATTRN_MAX_LENGTH) ? 
+        position - AC_PATTRN_MAX_LENGTH : 0;
+    
+    while (position_r < instr->length)
+    {
+        if (!(next = node_find_next_fast 
+                (current, instr->astring[position_r])))
+        {
+            if(current->failure_node)
+            {
+                current = current->failure_node;
+                continue;
+            }
+            position_r++;
+        }
+        else
+        {
+            current = next;
+            position_r++;
+            
+            if (current->final && current->to_be_replaced)
+            {
+                /* The longest to-be-replaced pattern ending here */
+                start = position_r - current->to_be_replaced->ptext.length;
+                
+                if (start < cut && position_r > cut)
+                    cut = position_r; /* Move the cut to the end of it */
+            }
+        }
+        
+        /* The patterns that end later, start after the current prefix */
+        if (position_r - current->depth >= cut)
+            return cut;
+    }
+    
+    return instr->length;
+}
+
+/**
+ * @brief Replaces the whole text in one chunk and collects the result
+ * 
+ * @param thiz
+ * @param instr
+ * @param mode
+ * @param position position of the text in the whole input
+ * @param out
+ * @return 
+ *****************************************************************************/
+static int mf_repdata_replace_all (AC_TRIE_t *thiz, AC_TEXT_t *instr, 
+        MF_REPLACE_MODE_t mode, size_t position, 
+        struct mf_replace_output *out)
+{
+    MF_REPLACEMENT_DATA_t *rd = &thiz->repdata;
+    int ret;
+    
+    /* Start from a clean state */
+    mf_repdata_reset (rd);
+    thiz->last_node = thiz->root;
+    thiz->base_position = position;
+    rd->curser = position;
+    
+    rd->cbf = NULL;
+    rd->scbf = mf_repdata_collect;
+    rd->user = out;
+    rd->dryrun = 0;
+    
+    if ((ret = mf_repdata_replace (thiz, instr, mode)))
+        return ret;
+    
+    multifast_rep_flush (thiz, 0);
+    
+    return 0;
+}
+
+/**
+ * @brief Copies the segments to the output of the one-shot replace functions
+ * 
+ * @param segs
+ * @param count
+ * @param user the output
+ *****************************************************************************/
+static void mf_repdata_collect (MF_SEGMENT_t *segs, size_t count, void *user)
+{
+    struct mf_replace_output *out = (struct mf_replace_output *) user;
+    size_t i, copy_len;
+    
+    for (i = 0; i < count; i++)
+    {
+        if (out->grow && out->length + segs[i].text.length > out->capacity)
+        {
+            while (out->length + segs[i].text.length > out->capacity)
+                out->capacity *= 2;
+            
+            out->buffer = (AC_ALPHABET_t *) realloc (out->buffer, 
+                    out->capacity * sizeof(AC_ALPHABET_t));
+        }
+        
+        if (out->length < out->capacity)
+        {
+            copy_len = out->capacity - out->length;
+            if (copy_len > segs[i].text.length)
+                copy_len = segs[i].text.length;
+            
+            memcpy (&out->buffer[out->length], segs[i].text.astring, 
+                    copy_len * sizeof(AC_ALPHABET_t));
+        }
+        
+        /* Keep counting if the buffer is full, to find out the needed size */
+        out->length += segs[i].text.length;
+    }
+}
+
+/**
+ * @brief Finds the patterns in the given chunk and replaces them
+ * 
+ * @param thiz
+ * @param instr
+ * @param mode
+ * @return 
+ *****************************************************************************/
+static int mf_repdata_replace 
+    (AC_TRIE_t *thiz, AC_TEXT_t *instr, MF_REPLACE_MODE_t mode)
 {
     ACT_NODE_t *current;
     ACT_NODE_t *next;
@@ -483,8 +1447,6 @@ int multifast_replace (AC_TRIE_t *thiz, AC_TEXT_t *instr,
     if (!rd->has_replacement)
         return -2; /* Trie doesn't have any to-be-replaced pattern */
     
-    rd->cbf = callback;
-    rd->user = param;
     rd->replace_mode = mode;
     
     thiz->text = instr; /* Save the input string in a helper variable 
@@ -497,7 +1459,8 @@ int multifast_replace (AC_TRIE_t *thiz, AC_TEXT_t *instr,
      */
     while (position_r < instr->length)
     {
-        if (!(next = node_find_next_bs(current, instr->astring[position_r])))
+        if (!(next = node_find_next_fast 
+                (current, instr->astring[position_r])))
         {
             /* Failed to follow a pattern */
             if(current->failure_node)
@@ -566,3 +1529,76 @@ void multifast_rep_flush (AC_TRIE_t *thiz, int keep)
         thiz->base_position = 0;
     }
 }
+
+/**
+ * @brief Sets the size of the replacement buffer. The call-back function 
+ * receives the replacement result in pieces of this size; a bigger buffer 
+ * means fewer calls, e.g. fewer write system calls. It can be called before 
+ * or after finalizing the trie, but not in the middle of a replacement.
+ * 
+ * @param thiz
+ * @param size the new buffer size; must be bigger than AC_PATTRN_MAX_LENGTH
+ * @return 0 on success, -1 if the size is not accepted
+ *****************************************************************************/
+int multifast_rep_set_bufsize (AC_TRIE_t *thiz, size_t size)
+{
+    MF_REPLACEMENT_DATA_t *rd = &thiz->repdata;
+    AC_ALPHABET_t *buffer;
+    
+    if (size <= AC_PATTRN_MAX_LENGTH || rd->buffer.length)
+        return -1;
+    
+    if (rd->buffer.astring)
+    {
+        buffer = (AC_ALPHABET_t *) realloc ((AC_ALPHABET_t *) 
+                rd->buffer.astring, size * sizeof(AC_ALPHABET_t));
+        if (!buffer)
+            return -1;
+        rd->buffer.astring = buffer;
+    }
+    
+    rd->buffer_size = size;
+    
+    return 0;
+}
+
+/**
+ * @brief Sets a call-back function which produces the replacement of every 
+ * to-be-replaced pattern occurrence, instead of the fixed replacement text 
+ * of the pattern. The call-back function writes the replacement directly 
+ * into the replacement buffer, so the replacement can depend on the 
+ * occurrence (e.g. a token for pseudonymization) and still be done in a 
+ * single pass. It can use pattern->rtext to keep the fixed replacement.
+ * 
+ * The clones of the trie use the same call-back function; so with 
+ * multifast_replace_parallel() it is called from several threads.
+ * 
+ * @param thiz
+ * @param callback the call-back function, or NULL to use the fixed 
+ * replacement texts again
+ * @param user the last parameter of the call-back function
+ *****************************************************************************/
+void multifast_rep_set_callback (AC_TRIE_t *thiz, 
+        MF_REPLACE_PATTERN_CALBACK_f callback, void *user)
+{
+    thiz->repdata.pcbf = callback;
+    thiz->repdata.puser = user;
+}
+
+/**
+ * @brief Tells the replace functions that the caller keeps every input chunk
+ * valid and unchanged until the next call to multifast_replace(), 
+ * multifast_replace_iov() or multifast_rep_flush() returns; e.g. the input 
+ * is mapped or double buffered. Then the tail of a chunk which may be the 
+ * beginning of a pattern is not copied to the backlog buffer if the backlog 
+ * is empty; the backlog refers to the chunk instead. If the chunks are 
+ * consecutive in the memory, the text before and after the chunk boundary 
+ * is given as one segment by multifast_replace_iov().
+ * 
+ * @param thiz
+ * @param stable 1 if the input is stable, 0 otherwise (default)
+ *****************************************************************************/
+void multifast_rep_set_stable (AC_TRIE_t *thiz, int stable)
+{
+    thiz->repdata.stable_input = stable ? 1 : 0;
+}
@@ -45,6 +45,25 @@ typedef enum mf_replace_mode
                              */
 } MF_REPLACE_MODE_t;
 
+/**
+ * The result of a dry-run replacement; see multifast_replace_dryrun()
+ */
+typedef struct mf_replace_stats
+{
+    size_t replacements;    /**< Total number of replacements */
+    size_t input_length;    /**< Length of the input */
+    size_t output_length;   /**< Length of the output if it was produced */
+} MF_REPLACE_STATS_t;
+
+/**
+ * The number of replacements of a pattern in a dry-run
+ */
+struct mf_replacement_count
+{
+    AC_PATTERN_t *pattern;
+    size_t count;
+};
+
 
 /** 
  * Before we replace any pattern we encounter, we should be patient
@@ -68,17 +87,30 @@ typedef struct mf_replacement_date
     AC_TEXT_t buffer;   /**< replacement buffer: maintains the result 
                          * of replacement */
     
+    size_t buffer_size; /**< Capacity of the replacement buffer */
+    
     AC_TEXT_t backlog;  /**< replacement backlog: if a pattern is divided 
                          * between two or more different chunks, then at the 
                          * end of the first chunk we need to keep it here until 
                          * the next chunk comes and we decide if it is a 
                          * pattern or just a pattern prefix. */
     
+    AC_ALPHABET_t *backlog_buffer;  /**< The storage of the backlog; with 
+                                     * stable input the backlog may refer to 
+                                     * the previous chunk instead */
+    short stable_input; /**< The previous chunk stays valid until the next 
+                         * call; see multifast_rep_set_stable() */
+    
     unsigned int has_replacement; /**< total number of to-be-replaced patterns 
                                    */
+    short same_length;  /**< Every to-be-replaced pattern has a replacement 
+                         * of the same length; see multifast_replace_inplace()
+                         */
     
-    struct mf_replacement_nominee *noms; /**< Replacement nominee array */
-    size_t noms_capacity; /**< Max capacity of the array */
+    struct mf_replacement_nominee *noms; /**< Replacement nominee array; it 
+                                          * is used as a circular queue */
+    size_t noms_capacity; /**< Max capacity of the array; a power of 2 */
+    size_t noms_head;  /**< Index of the first nominee in the array */
     size_t noms_size;  /**< Number of nominees in the array */
     
     size_t curser; /**< the position in the input text before which all 
@@ -88,6 +120,26 @@ typedef struct mf_replacement_date
     MF_REPLACE_MODE_t replace_mode;  /**< Replace mode */
     
     MF_REPLACE_CALBACK_f cbf;   /**< Callback function */
+    MF_REPLACE_SEGMENT_CALBACK_f scbf;  /**< Segment callback function; if it
+                                         * is set, the result is given in 
+                                         * segments instead of the buffer */
+    
+    MF_REPLACE_PATTERN_CALBACK_f pcbf;  /**< Produces the replacements, if 
+                                         * it is set; see 
+                                         * multifast_rep_set_callback() */
+    void *puser;    /**< User parameter of the pcbf */
+    
+    short dryrun;   /**< Only count the replacements; no output is made */
+    MF_REPLACE_STATS_t stats;   /**< The result of the dry-run */
+    struct mf_replacement_count *counts;    /**< Replacement count of every 
+                                             * pattern; a hash table */
+    size_t counts_capacity; /**< Size of the hash table; a power of 2 */
+    size_t counts_size;     /**< Number of patterns in the hash table */
+    
+    MF_SEGMENT_t *segs;     /**< Segments of the result (segment mode) */
+    size_t segs_capacity;   /**< Max capacity of the segments array */
+    size_t segs_size;       /**< Number of segments in the array */
+
     void *user;    /**< User parameters sent to the callback function */
     
     struct ac_trie *trie; /**< Pointer to the trie */
@@ -0,0 +1,227 @@
+/*
+ * statictrie.hpp: An Aho-Corasick automaton which is built at compile time
+ * This file is part of multifast.
+ *
+    Copyright 2010-2015 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _STATICTRIE_HPP_
+#define _STATICTRIE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+#include <type_traits>
+
+#include "symboltrie.hpp"
+
+namespace multifast
+{
+
+/**
+ * @brief Counts the nodes of the trie of the patterns, including the root.
+ * Every distinct prefix of the patterns is a node.
+ */
+template <std::size_t Count>
+constexpr std::size_t staticTrieNodes (
+        const std::string_view (&patterns)[Count])
+{
+    std::size_t nodes = 1;
+    
+    for (std::size_t i = 0; i < Count; i++)
+    {
+        for (std::size_t length = 1; length <= patterns[i].size (); length++)
+        {
+            std::string_view prefix = patterns[i].substr (0, length);
+            bool seen = false;
+            
+            for (std::size_t j = 0; j < i && !seen; j++)
+                seen = patterns[j].substr (0, length) == prefix;
+            
+            if (!seen)
+                nodes++;
+        }
+    }
+    return nodes;
+}
+
+/**
+ * The Aho-Corasick automaton of a fixed set of patterns, built by a
+ * constexpr constructor. If it is a constexpr object, the whole transition
+ * table is computed by the compiler and embedded in the binary; there is
+ * nothing to build at run time.
+ *
+ * Every state has the next state of all 256 alphas, so the search loop has
+ * no failure transitions and no edge lookup; it is one table load per alpha.
+ * The table has Nodes * 256 states, so it is meant for small dictionaries,
+ * e.g. keywords or protocol header names. The states are 8-bit if they fit.
+ *
+ * The ID of a pattern is its index in the pattern array. An empty pattern is
+ * ignored, and of the duplicate patterns the first one is accepted.
+ *
+ * Use makeStaticTrie() to get the automaton of a constexpr pattern array.
+ */
+template <std::size_t Nodes, std::size_t Count>
+class StaticTrie
+{
+public:
+
+    using State = std::conditional_t<(Nodes <= 0x100), std::uint8_t,
+            std::conditional_t<(Nodes <= 0x10000), std::uint16_t,
+            std::uint32_t>>;
+    
+    constexpr StaticTrie (const std::string_view (&patterns)[Count])
+        : m_next (), m_pattern (), m_output (), m_lengths ()
+    {
+        State failure[Nodes] = {};
+        State queue[Nodes] = {};
+        std::size_t nodes = 1;
+        
+        for (std::size_t n = 0; n < Nodes; n++)
+            m_pattern[n] = NO_PATTERN;
+        
+        // The trie; the missing edges of the root go to the root itself
+        for (std::size_t i = 0; i < Count; i++)
+        {
+            State node = ROOT;
+            
+            m_lengths[i] = patterns[i].size ();
+            
+            if (patterns[i].empty ())
+                continue;
+            
+            for (char ch : patterns[i])
+            {
+                State &next = m_next[node][static_cast<unsigned char> (ch)];
+                
+                if (next == ROOT)
+                    next = static_cast<State> (nodes++);
+                node = next;
+            }
+            
+            if (m_pattern[node] == NO_PATTERN)
+                m_pattern[node] = static_cast<std::int32_t> (i);
+        }
+        
+        // Breadth-first, so the failure node of a node is done before it.
+        // The missing edges of a node are those of its failure node
+        std::size_t head = 0, tail = 0;
+        
+        for (std::size_t alpha = 0; alpha < ALPHAS; alpha++)
+            if (m_next[ROOT][alpha] != ROOT)
+                queue[tail++] = m_next[ROOT][alpha];
+        
+        while (head < tail)
+        {
+            State node = queue[head++];
+            
+            for (std::size_t alpha = 0; alpha < ALPHAS; alpha++)
+            {
+                State &next = m_next[node][alpha];
+                State fail = m_next[failure[node]][alpha];
+                
+                if (next == ROOT)
+                {
+                    next = fail;
+                    continue;
+                }
+                
+                failure[next] = fail;
+                
+                // The nearest node on the failure chain that has a pattern
+                m_output[next] = (m_pattern[fail] != NO_PATTERN) ?
+                        fail : m_output[fail];
+                
+                queue[tail++] = next;
+            }
+        }
+    }
+    
+    /**
+     * @brief Searches the text. It can also be evaluated at compile time.
+     *
+     * The callable takes a const SymbolMatch & and returns void, or bool to
+     * stop the search by true.
+     *
+     * @return 0: the text was searched to the end, 1: the callback stopped
+     * the search
+     */
+    template <class Callback>
+    constexpr int search (std::string_view text, Callback &&callback) const
+    {
+        State node = ROOT;
+        
+        for (std::size_t position = 0; position < text.size (); position++)
+        {
+            node = m_next[node][static_cast<unsigned char> (text[position])];
+            
+            State match = (m_pattern[node] != NO_PATTERN) ?
+                    node : m_output[node];
+            
+            for (; match != ROOT; match = m_output[match])
+            {
+                SymbolMatch m = {position + 1,
+                        m_lengths[m_pattern[match]], m_pattern[match]};
+                
+                if constexpr (std::is_void_v<
+                        std::invoke_result_t<Callback &, const SymbolMatch &>>)
+                    callback (m);
+                else if (callback (m))
+                    return 1;
+            }
+        }
+        return 0;
+    }
+    
+    /** @brief Counts the matches of the text */
+    constexpr std::size_t count (std::string_view text) const
+    {
+        std::size_t matches = 0;
+        
+        search (text, [&matches] (const SymbolMatch &) {matches++;});
+        return matches;
+    }
+
+private:
+
+    static constexpr State ROOT = 0;
+    static constexpr std::int32_t NO_PATTERN = -1;
+    static constexpr std::size_t ALPHAS = 256;
+    
+    State m_next[Nodes][ALPHAS];    // Next state of every alpha
+    std::int32_t m_pattern[Nodes];  // Pattern of every state
+    State m_output[Nodes];  // Next state with a pattern on the failure chain
+    std::size_t m_lengths[Count];   // Lengths of the patterns
+};
+
+/**
+ * @brief Makes the automaton of a pattern array, which must be a constexpr
+ * array with static storage:
+ *
+ *     static constexpr std::string_view methods[] = {"GET", "POST"};
+ *     static constexpr auto trie = multifast::makeStaticTrie<methods> ();
+ */
+template <const auto &Patterns>
+constexpr auto makeStaticTrie ()
+{
+    return StaticTrie<staticTrieNodes (Patterns), std::size (Patterns)>
+            (Patterns);
+}
+
+} // namespace multifast
+
+#endif
@@ -0,0 +1,409 @@
+/*
+ * symboltrie.hpp: A header-only Aho-Corasick trie over any symbol type
+ * This file is part of multifast.
+ *
+    Copyright 2010-2015 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SYMBOLTRIE_HPP_
+#define _SYMBOLTRIE_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "actypes.h"
+
+namespace multifast
+{
+
+/**
+ * A match of a pattern in a symbol stream. The match ends right before
+ * 'position', so it starts at position - length.
+ */
+struct SymbolMatch
+{
+    std::size_t position;   /**< End position of the match in the input */
+    std::size_t length;     /**< Length of the pattern */
+    long id;                /**< Identifier of the pattern */
+};
+
+/**
+ * The Aho-Corasick trie over the symbols of type Symbol, which can be any
+ * integer or enumeration type, e.g. the 16 or 32-bit token IDs of a
+ * tokenized stream. The AC_TRIE_t of the C library only matches bytes.
+ *
+ * The patterns are added, then the trie is finalized and searched like the
+ * C trie; the status codes are the same. After finalizing, the edges of all
+ * nodes are kept sorted in one array; a node with a few edges is searched
+ * linearly, and a node with more edges by binary search. If the symbols
+ * have at most 16 bits, the root, which is visited the most, has a direct
+ * table of its next nodes.
+ *
+ * The matches are reported to a callable, like multifast::Trie::search().
+ */
+template <class Symbol>
+class SymbolTrie
+{
+    static_assert (std::is_integral_v<Symbol> || std::is_enum_v<Symbol>,
+            "The symbols must be integers or enumerations");
+
+public:
+
+    using symbol_type = Symbol;
+    
+    SymbolTrie () : m_open (true), m_lastNode (ROOT), m_basePosition (0)
+    {
+        m_build.emplace_back ();
+    }
+    
+    /**
+     * @brief Adds a pattern
+     *
+     * @return ACERR_SUCCESS, ACERR_ZERO_PATTERN, ACERR_DUPLICATE_PATTERN or
+     * ACERR_TRIE_CLOSED
+     */
+    AC_STATUS_t addPattern (const Symbol *pattern, std::size_t length,
+            long id)
+    {
+        if (!m_open)
+            return ACERR_TRIE_CLOSED;
+        
+        if (!length)
+            return ACERR_ZERO_PATTERN;
+        
+        std::uint32_t node = ROOT;
+        
+        for (std::size_t i = 0; i < length; i++)
+        {
+            auto found = m_edges.find (edgeKey (node, pattern[i]));
+            
+            if (found != m_edges.end ())
+            {
+                node = found->second;
+                continue;
+            }
+            
+            std::uint32_t next = static_cast<std::uint32_t> (m_build.size ());
+            m_build.emplace_back ();
+            m_edges.emplace (edgeKey (node, pattern[i]), next);
+            node = next;
+        }
+        
+        if (m_build[node].pattern != NO_PATTERN)
+            return ACERR_DUPLICATE_PATTERN;
+        
+        m_build[node].pattern = static_cast<std::int32_t> (m_patterns.size ());
+        m_patterns.push_back ({length, id});
+        
+        return ACERR_SUCCESS;
+    }
+    
+    /** @brief Adds a pattern from a container of symbols */
+    template <class Container>
+    AC_STATUS_t addPattern (const Container &pattern, long id)
+    {
+        return addPattern (std::data (pattern), std::size (pattern), id);
+    }
+    
+    /**
+     * @brief Finalizes the trie: sorts the edges and locates the failure
+     * nodes. No pattern can be added after it.
+     */
+    void finalize ()
+    {
+        if (!m_open)
+            return;
+        
+        std::size_t count = m_build.size ();
+        std::vector<BuildEdge> edges;
+        
+        edges.reserve (m_edges.size ());
+        for (const auto &edge : m_edges)
+            edges.push_back ({static_cast<std::uint32_t> (edge.first >> 32),
+                    static_cast<Symbol> (edge.first & SYMBOL_MASK),
+                    edge.second});
+        
+        std::sort (edges.begin (), edges.end (),
+                [] (const BuildEdge &a, const BuildEdge &b)
+                {
+                    return a.node != b.node ? a.node < b.node :
+                            symbolIndex (a.symbol) < symbolIndex (b.symbol);
+                });
+        
+        // The edges of node n are [m_offsets[n], m_offsets[n+1])
+        m_offsets.assign (count + 1, 0);
+        m_symbols.resize (edges.size ());
+        m_targets.resize (edges.size ());
+        
+        for (std::size_t i = 0; i < edges.size (); i++)
+        {
+            m_offsets[edges[i].node + 1]++;
+            m_symbols[i] = edges[i].symbol;
+            m_targets[i] = edges[i].next;
+        }
+        for (std::size_t n = 0; n < count; n++)
+            m_offsets[n + 1] += m_offsets[n];
+        
+        if constexpr (sizeof (Symbol) <= 2)
+        {
+            m_rootTable.assign (std::size_t (1) << (8 * sizeof (Symbol)),
+                    ROOT);
+            for (std::uint32_t i = m_offsets[ROOT]; i < m_offsets[ROOT + 1];
+                    i++)
+                m_rootTable[symbolIndex (m_symbols[i])] = m_targets[i];
+        }
+        
+        m_pattern.resize (count);
+        m_failure.assign (count, ROOT);
+        m_output.assign (count, ROOT);
+        
+        for (std::size_t n = 0; n < count; n++)
+            m_pattern[n] = m_build[n].pattern;
+        
+        // Breadth-first, so the failure node of a node is done before it
+        std::vector<std::uint32_t> queue;
+        queue.reserve (count);
+        queue.push_back (ROOT);
+        
+        for (std::size_t head = 0; head < queue.size (); head++)
+        {
+            std::uint32_t node = queue[head];
+            
+            for (std::uint32_t i = m_offsets[node]; i < m_offsets[node + 1];
+                    i++)
+            {
+                std::uint32_t child = m_targets[i];
+                std::uint32_t fail = ROOT;
+                
+                if (node != ROOT)
+                    fail = step (m_failure[node], m_symbols[i]);
+                
+                m_failure[child] = fail;
+                
+                // The nearest node on the failure chain that has a pattern
+                m_output[child] = (m_pattern[fail] != NO_PATTERN) ?
+                        fail : m_output[fail];
+                
+                queue.push_back (child);
+            }
+        }
+        
+        m_build.clear ();
+        m_build.shrink_to_fit ();
+        m_edges.clear ();
+        m_edges.rehash (0);
+        m_open = false;
+    }
+    
+    /**
+     * @brief Searches the symbols. If keep is true, the text is the next
+     * chunk of the previous text, and the positions continue from there.
+     *
+     * @return -1: the trie is not finalized, 0: the text was searched to the
+     * end, 1: the callback stopped the search
+     */
+    template <class Callback>
+    int search (const Symbol *text, std::size_t length, Callback &&callback,
+            bool keep = false)
+    {
+        if (m_open)
+            return -1;
+        
+        std::uint32_t node = keep ? m_lastNode : ROOT;
+        std::size_t base = keep ? m_basePosition : 0;
+        
+        for (std::size_t position = 0; position < length; position++)
+        {
+            node = step (node, text[position]);
+            
+            if ((m_pattern[node] != NO_PATTERN || m_output[node] != ROOT) &&
+                    report (node, base + position + 1, callback))
+            {
+                m_lastNode = node;
+                m_basePosition = base + position + 1;
+                return 1;
+            }
+        }
+        
+        m_lastNode = node;
+        m_basePosition = base + length;
+        return 0;
+    }
+    
+    /** @brief Searches a container of symbols */
+    template <class Container, class Callback>
+    int search (const Container &text, Callback &&callback, bool keep = false)
+    {
+        return search (std::data (text), std::size (text),
+                std::forward<Callback> (callback), keep);
+    }
+    
+    std::size_t patternsCount () const
+    {
+        return m_patterns.size ();
+    }
+    
+    std::size_t nodesCount () const
+    {
+        return m_open ? m_build.size () : m_pattern.size ();
+    }
+
+private:
+
+    static constexpr std::uint32_t ROOT = 0;
+    static constexpr std::int32_t NO_PATTERN = -1;
+    static constexpr std::uint64_t SYMBOL_MASK = 0xFFFFFFFFU;
+    
+    /** Nodes with more edges are searched by binary search */
+    static constexpr std::uint32_t LINEAR_MAX_EDGES = 8;
+    
+    static_assert (sizeof (Symbol) <= 4, "The symbols must fit in 32 bits");
+    
+    struct PatternInfo
+    {
+        std::size_t length;
+        long id;
+    };
+    
+    struct BuildNode
+    {
+        std::int32_t pattern = NO_PATTERN;
+    };
+    
+    struct BuildEdge
+    {
+        std::uint32_t node;
+        Symbol symbol;
+        std::uint32_t next;
+    };
+    
+    /** @brief The symbol as an unsigned number; it orders the edges */
+    static std::uint32_t symbolIndex (Symbol symbol)
+    {
+        if constexpr (std::is_enum_v<Symbol>)
+            return static_cast<std::make_unsigned_t<
+                    std::underlying_type_t<Symbol>>> (symbol);
+        else
+            return static_cast<std::make_unsigned_t<Symbol>> (symbol);
+    }
+    
+    static std::uint64_t edgeKey (std::uint32_t node, Symbol symbol)
+    {
+        return (std::uint64_t (node) << 32) | symbolIndex (symbol);
+    }
+    
+    /** @brief Finds the next node of an edge; ROOT if there is none */
+    std::uint32_t findNext (std::uint32_t node, Symbol symbol) const
+    {
+        const Symbol *first = m_symbols.data () + m_offsets[node];
+        const Symbol *last = m_symbols.data () + m_offsets[node + 1];
+        std::uint32_t key = symbolIndex (symbol);
+        
+        if (last - first <= LINEAR_MAX_EDGES)
+        {
+            for (const Symbol *s = first; s < last; s++)
+                if (*s == symbol)
+                    return m_targets[s - m_symbols.data ()];
+            return ROOT;
+        }
+        
+        const Symbol *found = std::lower_bound (first, last, key,
+                [] (Symbol a, std::uint32_t b) {return symbolIndex (a) < b;});
+        
+        if (found != last && symbolIndex (*found) == key)
+            return m_targets[found - m_symbols.data ()];
+        return ROOT;
+    }
+    
+    /** @brief The goto function of the automaton */
+    std::uint32_t step (std::uint32_t node, Symbol symbol) const
+    {
+        std::uint32_t next;
+        
+        if constexpr (sizeof (Symbol) <= 2)
+        {
+            while (node != ROOT)
+            {
+                if ((next = findNext (node, symbol)) != ROOT)
+                    return next;
+                node = m_failure[node];
+            }
+            return m_rootTable[symbolIndex (symbol)];
+        }
+        else
+        {
+            for (;;)
+            {
+                if ((next = findNext (node, symbol)) != ROOT ||
+                        node == ROOT)
+                    return next;
+                node = m_failure[node];
+            }
+        }
+    }
+    
+    /** @brief Reports the matches at a node; true stops the search */
+    template <class Callback>
+    bool report (std::uint32_t node, std::size_t position,
+            Callback &callback) const
+    {
+        if (m_pattern[node] == NO_PATTERN)
+            node = m_output[node];
+        
+        for (; node != ROOT; node = m_output[node])
+        {
+            const PatternInfo &patt = m_patterns[m_pattern[node]];
+            SymbolMatch match = {position, patt.length, patt.id};
+            
+            if constexpr (std::is_void_v<
+                    std::invoke_result_t<Callback &, const SymbolMatch &>>)
+                callback (match);
+            else if (callback (match))
+                return true;
+        }
+        return false;
+    }
+    
+    bool m_open;
+    
+    // Build time data
+    std::vector<BuildNode> m_build;
+    std::unordered_map<std::uint64_t, std::uint32_t> m_edges;
+    
+    // The finalized trie; the nodes are indexes of the arrays
+    std::vector<std::uint32_t> m_offsets;   // Edges of every node
+    std::vector<Symbol> m_symbols;          // Sorted symbols of the edges
+    std::vector<std::uint32_t> m_targets;   // Next nodes of the edges
+    std::vector<std::uint32_t> m_rootTable; // Next nodes of the root
+    std::vector<std::uint32_t> m_failure;   // Failure nodes
+    std::vector<std::uint32_t> m_output;    // Next node with a pattern on
+                                            // the failure chain
+    std::vector<std::int32_t> m_pattern;    // Pattern of every node
+    std::vector<PatternInfo> m_patterns;
+    
+    std::uint32_t m_lastNode;       // Where the last chunk was left
+    std::size_t m_basePosition;     // Position of the next chunk
+};
+
+} // namespace multifast
+
+#endif
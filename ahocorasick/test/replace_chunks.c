@@ -0,0 +1,247 @@
+/*
+ * replace_chunks.c: Checks that replacing a text chunk by chunk gives the
+ * same result as replacing it at once
+ *
+ * This file is part of multifast.
+ *
+    Copyright 2010-2015 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ahocorasick.h"
+
+#define TEXT_LENGTH     4096
+#define PATTERN_COUNT   8
+#define PATTERN_MAX     100
+#define ROUNDS          200
+
+/* The overlapping patterns may be replaced more than once, so the result can
+ * be longer than the text */
+#define RESULT_SIZE     (4 * TEXT_LENGTH)
+
+/* The result of a replacement is collected here */
+struct result
+{
+    AC_ALPHABET_t *astring;
+    size_t length;
+};
+
+static AC_ALPHABET_t text[TEXT_LENGTH];
+static AC_ALPHABET_t patterns[PATTERN_COUNT][PATTERN_MAX];
+static AC_ALPHABET_t replacements[PATTERN_COUNT][PATTERN_MAX];
+
+static void result_append (struct result *res, const AC_ALPHABET_t *astring,
+        size_t length)
+{
+    if (res->length + length > RESULT_SIZE)
+    {
+        printf ("The result is longer than %d\n", RESULT_SIZE);
+        exit (1);
+    }
+    memcpy (&res->astring[res->length], astring, length);
+    res->length += length;
+}
+
+static void collect_text (AC_TEXT_t *out, void *param)
+{
+    result_append ((struct result *) param, out->astring, out->length);
+}
+
+static void collect_segments (MF_SEGMENT_t *segs, size_t count, void *param)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++)
+        result_append ((struct result *) param,
+                segs[i].text.astring, segs[i].text.length);
+}
+
+/**
+ * @brief Makes a trie of random patterns; the long ones share a prefix, so
+ * the end of a chunk is often a prefix of a long pattern
+ */
+static AC_TRIE_t *make_trie (void)
+{
+    AC_TRIE_t *trie = ac_trie_create ();
+    AC_PATTERN_t patt;
+    size_t i, j, length;
+
+    for (i = 0; i < PATTERN_COUNT; i++)
+    {
+        length = (i < PATTERN_COUNT / 2) ?
+                PATTERN_MAX - (size_t) (rand () % 4) :
+                1 + (size_t) (rand () % 6);
+
+        for (j = 0; j < length; j++)
+            patterns[i][j] = (j < length - 1 || i >= PATTERN_COUNT / 2) ?
+                    "ab"[rand () % 2] : 'X';
+
+        if (i < PATTERN_COUNT / 2)
+            memset (patterns[i], 'a', PATTERN_MAX / 2);
+
+        memset (replacements[i], '0' + (int) i, length);
+
+        patt.ptext.astring = patterns[i];
+        patt.ptext.length = length;
+        patt.rtext.astring = replacements[i];
+        patt.rtext.length = (size_t) (rand () % (int) length);
+        patt.id.u.number = (long) i;
+        patt.id.type = AC_PATTID_TYPE_NUMBER;
+
+        ac_trie_add (trie, &patt, 1);
+    }
+    ac_trie_finalize (trie);
+
+    return trie;
+}
+
+/**
+ * @brief Makes a text of long runs of 'a', which are prefixes of the long
+ * patterns, with some whole patterns in between
+ */
+static void make_text (void)
+{
+    size_t i = 0, length;
+    AC_ALPHABET_t *pattern;
+
+    while (i < TEXT_LENGTH)
+    {
+        if (rand () % 3)
+        {
+            pattern = patterns[rand () % PATTERN_COUNT];
+            length = PATTERN_MAX;
+        }
+        else
+        {
+            pattern = NULL;
+            length = 1 + (size_t) (rand () % PATTERN_MAX);
+        }
+
+        if (length > TEXT_LENGTH - i)
+            length = TEXT_LENGTH - i;
+
+        if (pattern)
+            memcpy (&text[i], pattern, length);
+        else
+            memset (&text[i], "abX"[rand () % 3], length);
+
+        i += length;
+    }
+}
+
+/**
+ * @brief Replaces the text in chunks shorter than the long patterns. Like the
+ * multifast program, the chunks are read alternately into the two adjacent
+ * halves of one buffer, so the previous chunk stays valid until the next
+ * call returns, and then it is overwritten.
+ */
+static void replace_chunked (AC_TRIE_t *trie, int stable, int iov,
+        struct result *res)
+{
+    AC_ALPHABET_t buffer[2 * PATTERN_MAX];
+    AC_TEXT_t chunk;
+    size_t position = 0;
+
+    chunk.astring = buffer;
+    res->length = 0;
+    multifast_rep_set_stable (trie, stable);
+
+    while (position < TEXT_LENGTH)
+    {
+        chunk.astring = (chunk.astring == buffer) ?
+                buffer + PATTERN_MAX : buffer;
+        chunk.length = 1 + (size_t) (rand () % (PATTERN_MAX / 2));
+
+        if (rand () % 8 == 0)
+            chunk.length = PATTERN_MAX;
+
+        if (chunk.length > TEXT_LENGTH - position)
+            chunk.length = TEXT_LENGTH - position;
+
+        /* Scribble over the half before it is read */
+        memset ((AC_ALPHABET_t *) chunk.astring, '#', PATTERN_MAX);
+        memcpy ((AC_ALPHABET_t *) chunk.astring, &text[position],
+                chunk.length);
+        position += chunk.length;
+
+        if (iov)
+            multifast_replace_iov (trie, &chunk, MF_REPLACE_MODE_NORMAL,
+                    collect_segments, res);
+        else
+            multifast_replace (trie, &chunk, MF_REPLACE_MODE_NORMAL,
+                    collect_text, res);
+    }
+    multifast_rep_flush (trie, 0);
+}
+
+
+int main (void)
+{
+    static AC_ALPHABET_t expected_buffer[RESULT_SIZE];
+    static AC_ALPHABET_t actual_buffer[RESULT_SIZE];
+    struct result expected = {expected_buffer, 0};
+    struct result actual = {actual_buffer, 0};
+    AC_TRIE_t *trie;
+    AC_TEXT_t whole;
+    int round, stable, iov, failures = 0;
+
+    srand (1);
+
+    for (round = 0; round < ROUNDS; round++)
+    {
+        trie = make_trie ();
+        make_text ();
+
+        /* The whole text at once is the reference */
+        whole.astring = text;
+        whole.length = TEXT_LENGTH;
+        expected.length = 0;
+        multifast_replace (trie, &whole, MF_REPLACE_MODE_NORMAL,
+                collect_text, &expected);
+        multifast_rep_flush (trie, 0);
+
+        for (stable = 0; stable <= 1; stable++)
+        {
+            for (iov = 0; iov <= 1; iov++)
+            {
+                replace_chunked (trie, stable, iov, &actual);
+
+                if (actual.length != expected.length || memcmp
+                        (actual.astring, expected.astring, actual.length))
+                {
+                    printf ("Round %d: %s %s replace differs\n", round,
+                            stable ? "stable" : "copied",
+                            iov ? "segment" : "buffer");
+                    failures++;
+                }
+            }
+        }
+
+        ac_trie_release (trie);
+    }
+
+    if (failures)
+    {
+        printf ("replace_chunks: %d failures\n", failures);
+        return 1;
+    }
+
+    printf ("replace_chunks: OK\n");
+    return 0;
+}
@@ -21,6 +21,8 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "ahocorasick.h"
 
 #define PATTERN(p,r)    {{p,sizeof(p)-1},{r,sizeof(r)-1},{{0},0}}
@@ -48,18 +50,23 @@ AC_TEXT_t input_chunks[] = {
 /* Define a call-back function of type MF_REPLACE_CALBACK_f */
 void listener (AC_TEXT_t *text, void *user);
 
+/* Define a call-back function of type MF_REPLACE_PATTERN_CALBACK_f */
+size_t tokenizer (AC_PATTERN_t *pattern, size_t position, 
+        AC_ALPHABET_t *buffer, size_t size, void *user);
+
 /* The call-back function is called when:
  *      1. the replacement buffer is full
  *      2. the _rep_flush() is called
  * 
- * Replacement buffer size is determined by the MF_REPLACEMENT_BUFFER_SIZE 
- * macro
+ * Replacement buffer size is MF_REPLACEMENT_BUFFER_SIZE by default, and can
+ * be changed by the _rep_set_bufsize() function
  */
 
 int main (int argc, char **argv)
 {
     unsigned int i;
     AC_TRIE_t *trie;
+    AC_TEXT_t whole_input, result;
     
     /* Get a new trie */
     trie = ac_trie_create ();
@@ -139,6 +146,39 @@ int main (int argc, char **argv)
     
     printf("\n");
     
+    /* If the whole input is available in memory, the _replace_buffer() 
+     * function gives the result in one buffer, without a call-back function
+     * and without calling _rep_flush(). The buffer must be freed by the 
+     * caller. The _replace_into() function writes the result into the 
+     * caller's buffer instead. */
+    
+    printf("\nOne-shot replace:\n");
+    
+    whole_input.astring = "experience the ease and simplicity of multifast";
+    whole_input.length = strlen (whole_input.astring);
+    
+    if (multifast_replace_buffer (trie, 
+            &whole_input, MF_REPLACE_MODE_NORMAL, &result) == 0)
+    {
+        printf ("%.*s\n", (int)result.length, result.astring);
+        free ((AC_ALPHABET_t *)result.astring);
+    }
+    
+    /* The replacement of every occurrence can be produced by a call-back 
+     * function instead of the fixed replacement text of the pattern; e.g. 
+     * to replace names with tokens in the same pass. */
+    
+    printf("\nReplacement call-back:\n");
+    
+    multifast_rep_set_callback (trie, tokenizer, 0);
+    
+    if (multifast_replace_buffer (trie, 
+            &whole_input, MF_REPLACE_MODE_NORMAL, &result) == 0)
+    {
+        printf ("%.*s\n", (int)result.length, result.astring);
+        free ((AC_ALPHABET_t *)result.astring);
+    }
+    
     /* Release the trie */
     ac_trie_release (trie);
     
@@ -149,3 +189,21 @@ void listener (AC_TEXT_t *text, void *user)
 {
     printf ("%.*s", (int)text->length, text->astring);
 }
+
+size_t tokenizer (AC_PATTERN_t *pattern, size_t position, 
+        AC_ALPHABET_t *buffer, size_t size, void *user)
+{
+    size_t i;
+    unsigned int hash = 2166136261u;
+    
+    /* FNV-1a hash of the pattern */
+    for (i = 0; i < pattern->ptext.length; i++)
+    {
+        hash ^= (unsigned char) pattern->ptext.astring[i];
+        hash *= 16777619u;
+    }
+    
+    /* The buffer has at least AC_PATTRN_MAX_LENGTH space */
+    return (size_t) snprintf (buffer, size, "<%08x@%lu>", 
+            hash, (unsigned long) position);
+}
@@ -0,0 +1,117 @@
+/*
+ * example5.c: Measures the replace throughput on a match-dense text
+ * 
+ * This file is part of multifast.
+ *
+    Copyright 2010-2015 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ahocorasick.h"
+
+#define PATTERN(p,r)    {{p,sizeof(p)-1},{r,sizeof(r)-1},{{0},0}}
+
+/* Short patterns over a small alphabet: a random text over the same 
+ * alphabet has a match at nearly every position */
+AC_PATTERN_t patterns[] = {
+    PATTERN("a", "1"),
+    PATTERN("ab", "22"),
+    PATTERN("ba", "333"),
+    PATTERN("abc", ""),
+    PATTERN("cab", "4"),
+    PATTERN("bcab", "55555"),
+    PATTERN("cc", "6"),
+    PATTERN("aaa", "777"),
+};
+#define PATTERN_COUNT (sizeof(patterns)/sizeof(AC_PATTERN_t))
+
+/* Chunk sizes to feed the replace engine with */
+size_t chunk_sizes[] = {4096, 65536, 1048576, 0 /* the whole text */};
+#define CHUNK_SIZES_COUNT (sizeof(chunk_sizes)/sizeof(size_t))
+
+/* The call-back function only counts the output */
+void listener (AC_TEXT_t *text, void *user);
+
+int main (int argc, char **argv)
+{
+    unsigned int i, j;
+    size_t text_size, position, chunk_size;
+    size_t output_size;
+    AC_TEXT_t chunk;
+    AC_ALPHABET_t *text;
+    AC_TRIE_t *trie;
+    MF_REPLACE_MODE_t mode;
+    clock_t start;
+    double seconds;
+    
+    text_size = (argc > 1 ? atoi(argv[1]) : 8) * 1024 * 1024;
+    
+    /* Generate the input text */
+    text = (AC_ALPHABET_t *) malloc (text_size);
+    srand (1);
+    for (position = 0; position < text_size; position++)
+        text[position] = "abc"[rand() % 3];
+    
+    trie = ac_trie_create ();
+    
+    for (i = 0; i < PATTERN_COUNT; i++)
+        ac_trie_add (trie, &patterns[i], 0);
+    
+    ac_trie_finalize (trie);
+    
+    printf ("%-8s %10s %12s %10s\n", "mode", "chunk", "output", "MB/s");
+    
+    for (i = 0; i < 2; i++)
+    {
+        mode = i ? MF_REPLACE_MODE_LAZY : MF_REPLACE_MODE_NORMAL;
+        
+        for (j = 0; j < CHUNK_SIZES_COUNT; j++)
+        {
+            chunk_size = chunk_sizes[j] ? chunk_sizes[j] : text_size;
+            output_size = 0;
+            start = clock ();
+            
+            for (position = 0; position < text_size; position += chunk_size)
+            {
+                chunk.astring = &text[position];
+                chunk.length = (text_size - position < chunk_size) ? 
+                    text_size - position : chunk_size;
+                
+                multifast_replace (trie, &chunk, mode, listener, 
+                        (void *)&output_size);
+            }
+            multifast_rep_flush (trie, 0);
+            
+            seconds = (double)(clock () - start) / CLOCKS_PER_SEC;
+            
+            printf ("%-8s %10lu %12lu %10.1f\n", i ? "lazy" : "normal", 
+                    chunk_size, output_size, 
+                    seconds > 0 ? text_size / seconds / 1048576 : 0);
+        }
+    }
+    
+    ac_trie_release (trie);
+    free (text);
+    
+    return 0;
+}
+
+void listener (AC_TEXT_t *text, void *user)
+{
+    *(size_t *)user += text->length;
+}
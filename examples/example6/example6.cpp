@@ -0,0 +1,112 @@
+/*
+ * example6.cpp: It shows how to use the C++17 interface of ahocorasick library
+ *
+ * This file is part of multifast.
+ *
+    Copyright 2010-2015 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <string_view>
+#include "ahocorasick.hpp"
+
+constexpr std::string_view sample_patterns[] = {
+    "city",
+    "clutter",
+    "ever",
+    "experience",
+    "neo",
+    "one",
+    "simplicity",
+    "utter",
+    "whatever",
+};
+
+constexpr std::string_view chunk1 =
+        "experience the ease and simplicity of multifast";
+constexpr std::string_view chunk2 = "whatever you are be a good one";
+constexpr std::string_view chunk3 = "out of clutter, find simplicity";
+
+
+int main (void)
+{
+    multifast::Trie trie;
+
+    for (long i = 0; i < (long) std::size(sample_patterns); i++)
+    {
+        // The patterns are static, so they are not copied
+        if (trie.addPattern(sample_patterns[i], i, false) != ACERR_SUCCESS)
+            std::cout << "Failed to add: " << sample_patterns[i] << std::endl;
+    }
+    trie.finalize();
+
+    auto print = [] (const multifast::Match &m)
+    {
+        std::cout
+                << "@" << m.position - m.length
+                << "\t#" << m.id
+                << "\t" << sample_patterns[m.id]
+                << std::endl;
+    };
+
+    std::cout << "Searching '" << chunk1 << "'" << std::endl;
+    trie.search(chunk1, print);
+
+    // The second chunk continues the first one
+    std::cout << "Searching '" << chunk2 << "'" << std::endl;
+    trie.search(chunk2, print, true);
+
+    // Stop at the first match
+    std::cout << "Searching '" << chunk3 << "' for the first match"
+            << std::endl;
+    trie.search(chunk3, [&print] (const multifast::Match &m)
+    {
+        print(m);
+        return true;
+    });
+
+    // Count the matches without printing them
+    size_t count = 0;
+    for (std::string_view chunk : {chunk1, chunk2, chunk3})
+        trie.search(chunk, [&count] (const multifast::Match &) {count++;});
+    std::cout << "Total matches: " << count << std::endl;
+
+    // Iterate the matches
+    std::cout << "Iterating '" << chunk2 << "'" << std::endl;
+    for (const multifast::Match &m : trie.matches(chunk2))
+        print(m);
+
+    // The matches work with the standard algorithms
+    auto range = trie.matches(chunk1);
+    auto longest = std::max_element(range.begin(), range.end(),
+            [] (const multifast::Match &a, const multifast::Match &b)
+            {
+                return a.length < b.length;
+            });
+    if (longest != range.end())
+        std::cout << "The longest match in chunk 1: "
+                << sample_patterns[longest->id] << std::endl;
+
+    // Non-overlapping matches
+    trie.setMatchMode(AC_MATCH_MODE_LEFTMOST_LONGEST);
+    std::cout << "Searching '" << chunk3 << "' in leftmost-longest mode"
+            << std::endl;
+    trie.search(chunk3, print);
+    trie.flush(print);
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+/*
+ * example7.cpp: It shows how to search a stream of token IDs
+ *
+ * This file is part of multifast.
+ *
+    Copyright 2010-2015 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "symboltrie.hpp"
+
+typedef std::uint16_t Token;
+
+// The vocabulary of a tokenized log; a token ID is its index
+const std::vector<std::string> vocabulary = {
+    "user", "login", "failed", "from", "host", "password", "accepted",
+    "session", "opened", "closed", "for", "root", "invalid",
+};
+
+Token token (const std::string &word)
+{
+    for (Token i = 0; i < vocabulary.size(); i++)
+        if (vocabulary[i] == word)
+            return i;
+    return 0xFFFF;
+}
+
+std::vector<Token> tokenize (const std::vector<std::string> &words)
+{
+    std::vector<Token> tokens;
+
+    for (const std::string &word : words)
+        tokens.push_back(token(word));
+    return tokens;
+}
+
+const std::vector<std::vector<std::string>> sample_patterns = {
+    {"login", "failed"},
+    {"invalid", "user"},
+    {"password", "accepted", "for", "root"},
+    {"session", "opened", "for", "root"},
+    {"for", "root"},
+};
+
+const std::vector<std::string> sample_log = {
+    "invalid", "user", "from", "host", "login", "failed", "for", "user",
+    "password", "accepted", "for", "root", "session", "opened", "for",
+    "root", "session", "closed",
+};
+
+
+int main (void)
+{
+    multifast::SymbolTrie<Token> trie;
+
+    for (long i = 0; i < (long) sample_patterns.size(); i++)
+        if (trie.addPattern(tokenize(sample_patterns[i]), i) != ACERR_SUCCESS)
+            std::cout << "Failed to add pattern #" << i << std::endl;
+    trie.finalize();
+
+    std::vector<Token> log = tokenize(sample_log);
+
+    std::cout << "Searching " << log.size() << " tokens" << std::endl;
+
+    trie.search(log, [] (const multifast::SymbolMatch &m)
+    {
+        std::cout << "@" << m.position - m.length << "\t#" << m.id << "\t";
+
+        for (const std::string &word : sample_patterns[m.id])
+            std::cout << word << " ";
+        std::cout << std::endl;
+    });
+
+    return 0;
+}
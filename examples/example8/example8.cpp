@@ -0,0 +1,64 @@
+/*
+ * example8.cpp: It shows how to build an automaton at compile time
+ *
+ * This file is part of multifast.
+ *
+    Copyright 2010-2015 Kamiar Kanani <kamiar.kanani@gmail.com>
+
+    multifast is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    multifast is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with multifast.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <string_view>
+#include "statictrie.hpp"
+
+static constexpr std::string_view header_names[] = {
+    "Host:",
+    "User-Agent:",
+    "Accept:",
+    "Accept-Encoding:",
+    "Content-Length:",
+    "Content-Type:",
+    "Cookie:",
+};
+
+// The automaton is computed by the compiler
+static constexpr auto headers = multifast::makeStaticTrie<header_names>();
+
+constexpr std::string_view request =
+        "GET /index.html HTTP/1.1\r\n"
+        "Host: www.example.com\r\n"
+        "User-Agent: multifast\r\n"
+        "Accept: text/html\r\n"
+        "Accept-Encoding: gzip\r\n"
+        "Cookie: id=1\r\n"
+        "\r\n";
+
+// So it can be searched by the compiler too
+static_assert(headers.count(request) == 5, "Five headers in the request");
+
+
+int main (void)
+{
+    std::cout << "The automaton has " << sizeof(headers)
+            << " bytes" << std::endl;
+
+    headers.search(request, [] (const multifast::SymbolMatch &m)
+    {
+        std::cout << "@" << m.position - m.length << "\t#" << m.id << "\t"
+                << header_names[m.id] << std::endl;
+    });
+
+    return 0;
+}
@@ -18,6 +18,8 @@
     along with multifast.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#define _GNU_SOURCE /* For copy_file_range() */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -26,7 +28,10 @@
 #include <dirent.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <errno.h>
 #include "pattern.h"
 #include "walker.h"
@@ -34,9 +39,29 @@
 
 #define STREAM_BUFFER_SIZE 4096
 
+/* Minimum size of the chunks in replace mode */
+#define REPLACE_CHUNK_SIZE 65536
+
+/* Size of the chunks of a mapped input file in replace mode */
+#define REPLACE_MAPPED_CHUNK_SIZE (1024*1024)
+
+/* Unchanged parts of the input smaller than this are written from the user 
+ * space; bigger parts are copied by the kernel if possible */
+#define REPLACE_PASSTHROUGH_MIN 8192
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+#if defined(__linux__) && defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+#define HAVE_COPY_FILE_RANGE
+#endif
+
 /* Program configuration */
 struct program_config config = 
-    {0, WORKING_MODE_SEARCH, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    {0, WORKING_MODE_SEARCH, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 
+    AC_MATCH_MODE_ALL, PATTERN_FORMAT_AX, 0};
 
 char *get_outfile_name (const char *dir, const char *file);
 int mkpath(const char *path, mode_t mode);
@@ -51,6 +76,8 @@ int main (int argc, char **argv)
 {
     int i;
     int clopt; /* Command line option */
+    long threads;
+    char *endptr;
     AC_TRIE_t *trie; /* Aho-Corasick trie pointer */
     char *infpath, *outfpath;
     
@@ -61,17 +88,64 @@ int main (int argc, char **argv)
     }
 
     /* Read Command line options */
-    while ((clopt = getopt(argc, argv, "P:R:lndxrpfivh")) != -1)
+    while ((clopt = getopt(argc, argv, "P:t:MR:IDj:sLFlndxrpfivh")) != -1)
     {
         switch (clopt)
         {
         case 'P':
             config.pattern_file_name = optarg;
             break;
+        case 't':
+            if (!strcmp(optarg, "ax"))
+                config.pattern_format = PATTERN_FORMAT_AX;
+            else if (!strcmp(optarg, "lines"))
+                config.pattern_format = PATTERN_FORMAT_LINES;
+            else if (!strcmp(optarg, "bin"))
+                config.pattern_format = PATTERN_FORMAT_BINARY;
+            else
+            {
+                fprintf (stderr, "Unknown pattern file format '%s'; "
+                        "use ax, lines or bin\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'M':
+            config.merge_duplicates = 1;
+            break;
         case 'R':
             config.w_mode = WORKING_MODE_REPLACE;
             config.output_dir = optarg;
             break;
+        case 'I':
+            config.w_mode = WORKING_MODE_REPLACE;
+            config.in_place = 1;
+            break;
+        case 'D':
+            config.w_mode = WORKING_MODE_REPLACE;
+            config.dry_run = 1;
+            break;
+        case 'j':
+            errno = 0;
+            threads = strtol (optarg, &endptr, 10);
+            if (errno || endptr == optarg || *endptr || threads < 1)
+            {
+                fprintf (stderr, "Invalid number of threads '%s'\n", optarg);
+                print_usage (argv[0]);
+                exit(1);
+            }
+            if (threads > MF_MAX_THREADS)
+                threads = MF_MAX_THREADS;
+            config.build_threads = (unsigned int) threads;
+            break;
+        case 's':
+            config.sort_patterns = 1;
+            break;
+        case 'L':
+            config.match_mode = AC_MATCH_MODE_LEFTMOST_LONGEST;
+            break;
+        case 'F':
+            config.match_mode = AC_MATCH_MODE_LEFTMOST_FIRST;
+            break;
         case 'l':
             config.lazy_replace = 1;
             break;
@@ -125,10 +199,33 @@ int main (int argc, char **argv)
         config.output_show_pattern = 1;
     }
     
+    if (config.build_threads > 1)
+        config.sort_patterns = 1; /* Threads only work on sorted patterns */
+    
+    if (config.match_mode != AC_MATCH_MODE_ALL && 
+            config.w_mode != WORKING_MODE_SEARCH)
+    {
+        fprintf (stderr, "Switches -L and -F are only applicable "
+                "in search mode\n");
+        exit(1);
+    }
+    
     if (config.lazy_replace && config.w_mode != WORKING_MODE_REPLACE)
     {
         fprintf (stderr, "Switch -l is not applicable. "
-                "It operates in replace mode. Use switch -R\n");
+                "It operates in replace mode. Use switch -R, -I or -D\n");
+        exit(1);
+    }
+    
+    if (config.in_place && (config.output_dir || config.insensitive))
+    {
+        fprintf (stderr, "Switch -I can not be used with -R or -i\n");
+        exit(1);
+    }
+    
+    if (config.dry_run && (config.output_dir || config.in_place))
+    {
+        fprintf (stderr, "Switch -D can not be used with -R or -I\n");
         exit(1);
     }
     
@@ -143,7 +240,11 @@ int main (int argc, char **argv)
         exit(1);
     
     if(config.verbosity)
+    {
         printf("Total Patterns: %lu\n", trie->patterns_count);
+        printf("Total Nodes: %lu, Edges: %lu\n", 
+                trie->nodes_count, trie->edges_count);
+    }
     
     if (config.w_mode == WORKING_MODE_SEARCH)
     {
@@ -179,9 +280,30 @@ int main (int argc, char **argv)
             return 1;
         }
         
+        if (config.in_place && !trie->repdata.same_length)
+        {
+            fprintf (stderr, "In-place replacement needs replacements of the "
+                    "same length as their patterns\n");
+            return 1;
+        }
+        
         for (i = 0; i < config.input_files_num; i++)
         {
             infpath = config.input_files[i];
+            
+            if (config.in_place)
+            {
+                if (!replace_inplace (trie, infpath))
+                    printf("Successfully replaced in place: %s\n", infpath);
+                continue;
+            }
+            
+            if (config.dry_run)
+            {
+                replace_dryrun (trie, infpath);
+                continue;
+            }
+            
             outfpath = get_outfile_name (config.output_dir, infpath);
             
             if (!replace_file (trie, infpath, outfpath))
@@ -254,6 +376,10 @@ int search_file (const char *filename, AC_TRIE_t *trie)
         keep = 1;
         
     } while (num_read == STREAM_BUFFER_SIZE);
+    
+    /* Get the matches which are held at the end of the input */
+    if (keep)
+        ac_trie_search_flush (trie, match_handler, &mparm);
 
     close (fd_input);
 
@@ -269,14 +395,14 @@ int replace_file (AC_TRIE_t *trie, const char *infile, const char *outfile)
     int fd_input; /* Input file descriptor */
     int fd_output; /* output file descriptor */
     static AC_TEXT_t intext; /* input text */
-    static AC_ALPHABET_t in_stream_buffer[STREAM_BUFFER_SIZE];
+    static AC_ALPHABET_t *in_stream_buffer = NULL;
+    static size_t in_stream_size = 0;
+    size_t chunk_size;
     static struct match_param uparm; /* user parameters */
     ssize_t num_read; /* Number of byes read from input file */
-    struct stat file_stat;
+    struct stat file_stat, out_stat;
     MF_REPLACE_MODE_t rpmod = MF_REPLACE_MODE_DEFAULT;
     
-    intext.astring = in_stream_buffer;
-
     /* Open input file */
     if (!strcmp(config.input_files[0], "-"))
     {
@@ -318,18 +444,62 @@ int replace_file (AC_TRIE_t *trie, const char *infile, const char *outfile)
         fd_output = 1; /* sent output to stdout */
     }
     
+    /* The output of every chunk is written at once, so the chunk size is 
+     * chosen to be a multiple of the output device block size */
+    chunk_size = REPLACE_CHUNK_SIZE;
+    
+    if (fstat(fd_output, &out_stat))
+        out_stat.st_mode = 0; /* Unknown output */
+    else if (out_stat.st_blksize > 0)
+        chunk_size = ((chunk_size + out_stat.st_blksize - 1) / 
+                out_stat.st_blksize) * out_stat.st_blksize;
+    
+    /* Two chunks are read alternately; the previous chunk stays valid while 
+     * the next one is replaced, so the replace need not copy its tail */
+    if (chunk_size > in_stream_size)
+    {
+        free (in_stream_buffer);
+        in_stream_buffer = (AC_ALPHABET_t *) malloc (2 * chunk_size);
+        in_stream_size = chunk_size;
+    }
+    
+    intext.astring = in_stream_buffer;
+    multifast_rep_set_stable (trie, 1);
+    
     /* Reset the parameter */
     uparm.item = 0;
     uparm.total_match = 0;
     uparm.fname = NULL; /* note used */
     uparm.out_file_d = fd_output;
+    uparm.in_file_d = -1;
+    
+    if (config.lazy_replace)
+        rpmod = MF_REPLACE_MODE_LAZY;
+    
+    /* The unchanged parts of a regular file can be copied by the kernel to 
+     * a regular output file; the case insensitive mode changes them */
+    if (S_ISREG(file_stat.st_mode) && S_ISREG(out_stat.st_mode) && 
+            !config.insensitive)
+        uparm.in_file_d = fd_input;
+    
+    /* Regular files are mapped and replaced by several threads or passed 
+     * through to the output */
+    if ((config.build_threads > 1 || uparm.in_file_d != -1) && 
+            S_ISREG(file_stat.st_mode) && file_stat.st_size > 0 && 
+            !replace_mapped (trie, fd_input, file_stat.st_size, rpmod, &uparm))
+    {
+        close (fd_input);
+        close (fd_output);
+        return 0;
+    }
     
     /* loop to load and search the input file repeatedly, chunk by chunk */
     do
     {
-        /* Read a chunk from input file */
-        num_read = read (fd_input, 
-                (void *)in_stream_buffer, STREAM_BUFFER_SIZE);
+        /* Read a chunk from input file into the other half of the buffer */
+        intext.astring = (intext.astring == in_stream_buffer) ? 
+                in_stream_buffer + in_stream_size : in_stream_buffer;
+        num_read = read (fd_input, (void *)intext.astring, chunk_size);
         
         if (num_read < 0)
         {
@@ -344,12 +514,9 @@ int replace_file (AC_TRIE_t *trie, const char *infile, const char *outfile)
 
         /* Handle case sensitivity */
         if (config.insensitive)
-            lower_case(in_stream_buffer, num_read);
-
-        if (config.lazy_replace)
-            rpmod = MF_REPLACE_MODE_LAZY;
+            lower_case((char *)intext.astring, num_read);
         
-        if (multifast_replace (trie, &intext, rpmod, 
+        if (multifast_replace_iov (trie, &intext, rpmod, 
                 replace_listener, &uparm))
             /* Break loop if call-back function has done its work */
             break;
@@ -492,7 +659,8 @@ char *get_outfile_name (const char *dir, const char *inpath)
 void print_usage (char *progname)
 {
     printf("MultiFast v%s Usage:\n%s "
-            "-P pattern_file [-R out_dir [-l] | -n[d|x]rpvfi] [-h] "
+            "-P pattern_file [-t ax|lines|bin] [-M] [-s] [-j threads] "
+            "[-R out_dir [-l] | -I [-l] | -D [-l] | -n[d|x]rpvfi[L|F]] [-h] "
             "file1 [file2 ...]\n", 
             XSTRINGIFY(MF_VERSION_NUMBER), progname);
 }
@@ -504,47 +672,402 @@ void print_usage (char *progname)
 int match_handler (AC_MATCH_t *m, void *param)
 {
     unsigned int j;
+    AC_PATTERN_t *patt;
     struct match_param *mparm = (struct match_param *)param;
     
     for (j=0; j < m->size; j++)
     {
-        /* if (mparm->item == 0) */
-        if (mparm->fname)
-            printf ("%s: ", mparm->fname);
+        /* The merged identifiers of the pattern are separate matches */
+        for (patt = &m->patterns[j]; patt; patt = patt->merged)
+        {
+            /* if (mparm->item == 0) */
+            if (mparm->fname)
+                printf ("%s: ", mparm->fname);
+            
+            if (config.output_show_item)
+                printf("#%ld ", ++mparm->item);
+            
+            if (config.output_show_dpos)
+                printf("@%ld ", m->position - patt->ptext.length + 1);
+            
+            if (config.output_show_xpos)
+                printf("@%08X ", (unsigned int)
+                        (m->position - patt->ptext.length + 1));
+            
+            if (config.output_show_reprv)
+                printf("%s ", patt->id.u.stringy);
+            
+            if (config.output_show_pattern)
+                pattern_print (patt);
+            
+            printf("\n");
+            
+            mparm->total_match++;
+        }
+    }
+    
+    if (config.find_first)
+        return 1; /* Find First Match */
+    else
+        return 0; /* Find all matches */
+}
+
+/******************************************************************************
+ * FUNCTION
+ *****************************************************************************/
+
+int replace_inplace (AC_TRIE_t *trie, const char *infile)
+{
+    int fd; /* Input and output file descriptor */
+    struct stat file_stat;
+    void *map;
+    int ret;
+    MF_REPLACE_MODE_t rpmod = MF_REPLACE_MODE_DEFAULT;
+    
+    if ((fd = open(infile, O_RDWR)) == -1)
+    {
+        fprintf(stderr, "Cannot open '%s' for writing\n", infile);
+        return -1;
+    }
+    
+    if (fstat(fd, &file_stat) || !S_ISREG(file_stat.st_mode))
+    {
+        fprintf(stderr, "In-place replacement only works on regular files: "
+                "skipped '%s'\n", infile);
+        close(fd);
+        return -1;
+    }
+    
+    if (file_stat.st_size == 0)
+    {
+        close(fd);
+        return 0;
+    }
+    
+    /* The changes to a shared map are written back to the file */
+    map = mmap (NULL, file_stat.st_size, PROT_READ|PROT_WRITE, MAP_SHARED, 
+            fd, 0);
+    
+    if (map == MAP_FAILED)
+    {
+        fprintf(stderr, "Cannot map '%s'\n", infile);
+        close(fd);
+        return -1;
+    }
+    
+    if (config.lazy_replace)
+        rpmod = MF_REPLACE_MODE_LAZY;
+    
+    ret = multifast_replace_inplace (trie, (AC_ALPHABET_t *) map, 
+            file_stat.st_size, rpmod);
+    
+    if (ret == -4)
+        fprintf(stderr, "Overlapping replacements in '%s'; skipped. "
+                "Use lazy mode (-l)\n", infile);
+    
+    munmap (map, file_stat.st_size);
+    close (fd);
+    
+    return ret;
+}
+
+/******************************************************************************
+ * FUNCTION
+ *****************************************************************************/
+
+/* The replacement counts of the current file in dry-run */
+static struct replace_count_s
+{
+    AC_PATTERN_t *patt;
+    size_t count;
+} *replace_counts = NULL;
+static size_t replace_counts_size = 0, replace_counts_capacity = 0;
+
+int replace_count_compare (const void *a, const void *b)
+{
+    const struct replace_count_s *ca = (const struct replace_count_s *) a;
+    const struct replace_count_s *cb = (const struct replace_count_s *) b;
+    const AC_TEXT_t *ta = &ca->patt->ptext, *tb = &cb->patt->ptext;
+    int ret;
+    
+    /* The most replaced pattern comes first */
+    if (ca->count != cb->count)
+        return (ca->count < cb->count) ? 1 : -1;
+    
+    /* The counts are reported in no particular order and qsort() is not 
+     * stable, so the ties are ordered by the ID and then by the pattern */
+    if ((ret = strcmp (ca->patt->id.u.stringy, cb->patt->id.u.stringy)))
+        return ret;
+    
+    if ((ret = memcmp (ta->astring, tb->astring, 
+            (ta->length < tb->length) ? ta->length : tb->length)))
+        return ret;
+    
+    if (ta->length != tb->length)
+        return (ta->length < tb->length) ? -1 : 1;
+    return 0;
+}
+
+int replace_dryrun (AC_TRIE_t *trie, const char *infile)
+{
+    int fd_input; /* Input file descriptor */
+    static AC_TEXT_t intext; /* input text */
+    static AC_ALPHABET_t *in_stream_buffer = NULL;
+    ssize_t num_read; /* Number of byes read from input file */
+    MF_REPLACE_MODE_t rpmod = MF_REPLACE_MODE_DEFAULT;
+    MF_REPLACE_STATS_t stats;
+    size_t i;
+    
+    /* Open input file */
+    if (!strcmp(config.input_files[0], "-"))
+    {
+        fd_input = 0; /* read from stdin */
+    }
+    else if ((fd_input = open(infile, O_RDONLY)) == -1)
+    {
+        fprintf(stderr, "Cannot read from input file '%s'\n", infile);
+        return -1;
+    }
+    
+    if (!in_stream_buffer)
+        in_stream_buffer = (AC_ALPHABET_t *) malloc 
+                (REPLACE_MAPPED_CHUNK_SIZE);
+    
+    intext.astring = in_stream_buffer;
+    multifast_rep_set_stable (trie, 0);
+    
+    if (config.lazy_replace)
+        rpmod = MF_REPLACE_MODE_LAZY;
+    
+    while ((num_read = read (fd_input, (void *)in_stream_buffer, 
+            REPLACE_MAPPED_CHUNK_SIZE)) > 0)
+    {
+        intext.length = num_read;
         
-        if (config.output_show_item)
-            printf("#%ld ", ++mparm->item);
+        if (config.insensitive)
+            lower_case(in_stream_buffer, num_read);
         
-        if (config.output_show_dpos)
-            printf("@%ld ", m->position - m->patterns[j].ptext.length + 1);
+        multifast_replace_dryrun (trie, &intext, rpmod);
+    }
+    
+    if (num_read < 0)
+        fprintf(stderr, "Error while reading from '%s'\n", infile);
+    
+    replace_counts_size = 0;
+    multifast_rep_stats (trie, &stats, replace_count, NULL);
+    
+    printf ("%s: %lu replacements, %lu bytes >> %lu bytes\n", infile, 
+            (unsigned long) stats.replacements, 
+            (unsigned long) stats.input_length, 
+            (unsigned long) stats.output_length);
+    
+    qsort (replace_counts, replace_counts_size, 
+            sizeof(struct replace_count_s), replace_count_compare);
+    
+    for (i = 0; i < replace_counts_size; i++)
+    {
+        printf ("%10lu %s ", (unsigned long) replace_counts[i].count, 
+                replace_counts[i].patt->id.u.stringy);
+        pattern_print (replace_counts[i].patt);
+        printf ("\n");
+    }
+    
+    if (fd_input)
+        close (fd_input);
+    
+    return 0;
+}
+
+/******************************************************************************
+ * FUNCTION
+ *****************************************************************************/
+
+void replace_count (AC_PATTERN_t *patt, size_t count, void *user)
+{
+    if (replace_counts_size == replace_counts_capacity)
+    {
+        replace_counts_capacity = replace_counts_capacity ? 
+                2 * replace_counts_capacity : 64;
+        replace_counts = (struct replace_count_s *) realloc (replace_counts,
+                replace_counts_capacity * sizeof(struct replace_count_s));
+    }
+    
+    replace_counts[replace_counts_size].patt = patt;
+    replace_counts[replace_counts_size].count = count;
+    replace_counts_size++;
+}
+
+/******************************************************************************
+ * FUNCTION
+ *****************************************************************************/
+
+int replace_mapped (AC_TRIE_t *trie, int fd_input, size_t size, 
+        MF_REPLACE_MODE_t rpmod, struct match_param *uparm)
+{
+    AC_TEXT_t intext;
+    void *map;
+    size_t position;
+    
+    /* A private writable map is needed for changing the case */
+    map = mmap (NULL, size, PROT_READ | (config.insensitive ? PROT_WRITE : 0),
+            MAP_PRIVATE, fd_input, 0);
+    
+    if (map == MAP_FAILED)
+        return -1; /* The caller reads the file instead */
+    
+    madvise (map, size, MADV_SEQUENTIAL);
+    
+    intext.astring = (AC_ALPHABET_t *) map;
+    intext.length = size;
+    
+    if (config.insensitive)
+        lower_case((char *) map, size);
+    
+    if (config.build_threads > 1)
+    {
+        multifast_replace_parallel (trie, &intext, rpmod, 
+                config.build_threads, replace_text_listener, uparm);
+    }
+    else
+    {
+        /* Feed the map in chunks; the unchanged parts of the input are 
+         * given back as segments of the map */
+        for (position = 0; position < size; position += intext.length)
+        {
+            intext.astring = (AC_ALPHABET_t *) map + position;
+            intext.length = (size - position < REPLACE_MAPPED_CHUNK_SIZE) ? 
+                    size - position : REPLACE_MAPPED_CHUNK_SIZE;
+            
+            multifast_replace_iov (trie, &intext, rpmod, 
+                    replace_passthrough_listener, uparm);
+        }
         
-        if (config.output_show_xpos)
-            printf("@%08X ", (unsigned int)
-                    (m->position - m->patterns[j].ptext.length + 1));
+        multifast_rep_flush (trie, 0);
+    }
+    
+    munmap (map, size);
+    
+    return 0;
+}
+
+/******************************************************************************
+ * FUNCTION
+ *****************************************************************************/
+
+void replace_text_listener (AC_TEXT_t *text, void *user)
+{
+    MF_SEGMENT_t seg;
+    
+    seg.text = *text;
+    seg.position = MF_SEGMENT_NOT_INPUT;
+    
+    replace_listener (&seg, 1, user);
+}
+
+/******************************************************************************
+ * FUNCTION
+ *****************************************************************************/
+
+void replace_passthrough_listener (MF_SEGMENT_t *segs, size_t count, 
+        void *user)
+{
+    struct match_param *uparm = (struct match_param *) user;
+    size_t i, first = 0;
+    
+    for (i = 0; i < count && uparm->in_file_d != -1; i++)
+    {
+        if (segs[i].position == MF_SEGMENT_NOT_INPUT || 
+                segs[i].text.length < REPLACE_PASSTHROUGH_MIN)
+            continue;
         
-        if (config.output_show_reprv)
-            printf("%s ", m->patterns[j].id.u.stringy);
+        /* Write the segments before it, then let the kernel copy it */
+        replace_listener (&segs[first], i - first, user);
+        replace_passthrough (&segs[i], uparm);
+        first = i + 1;
+    }
+    
+    replace_listener (&segs[first], count - first, user);
+}
+
+/******************************************************************************
+ * FUNCTION
+ *****************************************************************************/
+
+void replace_passthrough (MF_SEGMENT_t *seg, struct match_param *uparm)
+{
+    MF_SEGMENT_t rest;
+    size_t done = 0;
+#ifdef HAVE_COPY_FILE_RANGE
+    loff_t in_offset = seg->position;
+    ssize_t copied;
+    
+    while (done < seg->text.length)
+    {
+        copied = copy_file_range (uparm->in_file_d, &in_offset, 
+                uparm->out_file_d, NULL, seg->text.length - done, 0);
         
-        if (config.output_show_pattern)
-            pattern_print (&m->patterns[j]);
+        if (copied <= 0)
+        {
+            /* Not supported for these files; do not try again */
+            uparm->in_file_d = -1;
+            break;
+        }
         
-        printf("\n");
+        done += copied;
     }
+#else
+    uparm->in_file_d = -1;
+#endif
     
-    mparm->total_match += m->size;
-    
-    if (config.find_first)
-        return 1; /* Find First Match */
-    else
-        return 0; /* Find all matches */
+    if (done < seg->text.length)
+    {
+        /* Write the rest from the user space */
+        rest.text.astring = seg->text.astring + done;
+        rest.text.length = seg->text.length - done;
+        rest.position = seg->position + done;
+        
+        replace_listener (&rest, 1, uparm);
+    }
 }
 
 /******************************************************************************
  * FUNCTION
  *****************************************************************************/
 
-void replace_listener (AC_TEXT_t *text, void *user)
+void replace_listener (MF_SEGMENT_t *segs, size_t count, void *user)
 {
-    write (((struct match_param *)user)->out_file_d, 
-            text->astring, text->length);
+    struct iovec iov[IOV_MAX];
+    size_t i, batch, first = 0;
+    ssize_t written;
+    int fd = ((struct match_param *)user)->out_file_d;
+    
+    while (first < count)
+    {
+        batch = (count - first < IOV_MAX) ? count - first : IOV_MAX;
+        
+        for (i = 0; i < batch; i++)
+        {
+            iov[i].iov_base = (void *) segs[first + i].text.astring;
+            iov[i].iov_len = segs[first + i].text.length;
+        }
+        
+        for (i = 0; i < batch; )
+        {
+            if ((written = writev (fd, &iov[i], batch - i)) < 0)
+                return;
+            
+            /* Skip the written segments, and the written part of a 
+             * partially written segment */
+            while (i < batch && (size_t) written >= iov[i].iov_len)
+                written -= iov[i++].iov_len;
+            
+            if (i < batch)
+            {
+                iov[i].iov_base = (char *) iov[i].iov_base + written;
+                iov[i].iov_len -= written;
+            }
+        }
+        
+        first += batch;
+    }
 }
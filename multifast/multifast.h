@@ -21,12 +21,22 @@
 #ifndef _MULTIFAST_H_
 #define _MULTIFAST_H_
 
+/* Upper bound of the -j option */
+#define MF_MAX_THREADS 256
+
 enum working_mode
 {
     WORKING_MODE_SEARCH = 0,
     WORKING_MODE_REPLACE
 };
 
+enum pattern_format
+{
+    PATTERN_FORMAT_AX = 0,  /* AX (ID) {PATTERN} > {REPLACEMENT} */
+    PATTERN_FORMAT_LINES,   /* PATTERN [TAB ID [TAB REPLACEMENT]] per line */
+    PATTERN_FORMAT_BINARY   /* Length-prefixed pattern, ID and replacement */
+};
+
 struct program_config
 {
     char *pattern_file_name;
@@ -38,20 +48,21 @@ struct program_config
     short verbosity;
     short insensitive;
     short lazy_replace;         /* Lazy replace mode */
+    short in_place;             /* Replace in the input files */
+    short dry_run;              /* Only count the replacements */
     short output_show_item;     /* Item number */
     short output_show_dpos;     /* Start position (decimal) */
     short output_show_xpos;     /* Start position (hex) */
     short output_show_reprv;    /* Representative */
     short output_show_pattern;  /* Pattern */
+    unsigned int build_threads; /* Threads used for building the trie and 
+                                 * replacing big files */
+    short sort_patterns;        /* Sort the patterns before adding them */
+    AC_MATCH_MODE_t match_mode; /* Which matches are reported */
+    enum pattern_format pattern_format; /* Format of the pattern file */
+    short merge_duplicates;     /* Merge the IDs of duplicate patterns */
 };
 
-void lower_case (char *s, size_t l);
-void print_usage (char *progname);
-int  search_file (const char *filename, AC_TRIE_t *trie);
-int  replace_file (AC_TRIE_t *trie, const char *infile, const char *outfile);
-int  match_handler (AC_MATCH_t *m, void *param);
-void replace_listener (AC_TEXT_t *, void *);
-
 /* Parameter to match_handler */
 struct match_param
 {
@@ -59,6 +70,24 @@ struct match_param
     unsigned long item;
     char *fname;
     int out_file_d;
+    int in_file_d;  /* Input file for passing through the unchanged parts, 
+                     * or -1 */
 };
 
+void lower_case (char *s, size_t l);
+void print_usage (char *progname);
+int  search_file (const char *filename, AC_TRIE_t *trie);
+int  replace_file (AC_TRIE_t *trie, const char *infile, const char *outfile);
+int  replace_inplace (AC_TRIE_t *trie, const char *infile);
+int  replace_dryrun (AC_TRIE_t *trie, const char *infile);
+void replace_count (AC_PATTERN_t *patt, size_t count, void *user);
+int  replace_count_compare (const void *a, const void *b);
+int  replace_mapped (AC_TRIE_t *trie, int fd_input, size_t size, 
+        MF_REPLACE_MODE_t rpmod, struct match_param *uparm);
+int  match_handler (AC_MATCH_t *m, void *param);
+void replace_listener (MF_SEGMENT_t *, size_t, void *);
+void replace_text_listener (AC_TEXT_t *, void *);
+void replace_passthrough_listener (MF_SEGMENT_t *, size_t, void *);
+void replace_passthrough (MF_SEGMENT_t *seg, struct match_param *uparm);
+
 #endif /* _MULTIFAST_H_ */
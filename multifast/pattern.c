@@ -23,6 +23,10 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
 
 #include "pattern.h"
 #include "reader.h"
@@ -30,14 +34,88 @@
 #include "multifast.h"
 
 static STRMM_t strmem;      /* Holds strings in memory for easy display */
+
+/* The pattern file stays in the memory; the patterns and replacements which 
+ * need no decoding refer to it instead of being copied */
+static void *pattern_map = MAP_FAILED;
+static size_t pattern_map_size;
+static char *pattern_whole;
 static AC_TRIE_t * trie;    /* Aho-Corasick trie */
 
+/* Patterns which are collected to be added in bulk */
+static AC_PATTERN_t *bulk_patts;
+static size_t bulk_size, bulk_capacity;
+
+/* The last token and the pattern which is being read */
+static enum token_type last_type = ENTOK_NONE;
+static AC_PATTERN_t last_pattern = {{NULL, 0}, {NULL, 0}, {{0}, 0}, NULL};
+
+/* The number of the next automatic pattern identifier */
+static int genrep_item = 1;
+
+/* A pattern which is read so far. The merged duplicates are told apart by 
+ * their IDs, so the ID is a part of the key if they are merged */
+struct seen_pattern_s
+{
+    AC_TEXT_t ptext;
+    const char *id;
+};
+
+/* The patterns which are read so far; duplicates are found here before 
+ * they reach the trie */
+static struct seen_pattern_s *seen;
+static size_t seen_size, seen_capacity;
+static size_t duplicates;   /* Number of skipped duplicates */
+
+/* Pattern files bigger than this are parsed by several threads */
+#define PATTERN_SHARD_MIN_SIZE (1024*1024)
+
+/* A pattern which is read by a shard */
+struct shard_pattern_s
+{
+    AC_PATTERN_t patt;
+    size_t autoid;  /* The order of its automatic identifier in the shard; 
+                     * the identifier is generated at the merge. 0 if the 
+                     * pattern has its own identifier */
+};
+
+/* A part of the pattern file which is parsed by a thread */
+struct pattern_shard_s
+{
+    const char *text;   /* The whole pattern file */
+    size_t size;
+    size_t begin;       /* The shard reads the patterns beginning in */
+    size_t end;         /* [begin, end) */
+    size_t next_begin;  /* Where the first pattern after the shard begins */
+    enum token_type last_type;  /* ENTOK_EOF, ENTOK_ERR or ENTOK_AX */
+    char *errmsg;
+    
+    STRMM_t strmem;     /* Holds the strings of the shard patterns */
+    struct shard_pattern_s *patts;
+    size_t patts_size, patts_capacity;
+    size_t autoids;     /* The number of automatic identifiers in the shard */
+    short threaded;     /* Parsed by its own thread */
+};
+
+static struct pattern_shard_s *shards;
+static size_t shards_count;
+
 extern struct program_config config;
 
 void pattern_print (AC_PATTERN_t *patt);
 void pattern_genrep (const char **id);
 void pattern_makeacopy (const AC_ALPHABET_t **astrp, size_t len);
 int  pattern_addtoac (AC_PATTERN_t *patt);
+void pattern_addbulk (void);
+void pattern_report (AC_PATTERN_t *patt, AC_STATUS_t status);
+int  pattern_isduplicate (AC_PATTERN_t *patt);
+static size_t pattern_hash (const AC_ALPHABET_t *str, size_t length);
+static size_t pattern_seen_hash (const AC_TEXT_t *ptext, const char *id);
+int  pattern_read_tokens (void);
+int  pattern_load_sharded (const char *text, size_t size);
+int  pattern_load_simple (FILE *fd, char *text, size_t size);
+int  pattern_load_lines (char *text, size_t size);
+int  pattern_load_binary (char *text, size_t size);
 
 /* The search call-back function */
 extern int match_handler (AC_MATCH_t *m, void *param);
@@ -50,10 +128,10 @@ int pattern_load (const char *infile, AC_TRIE_t **ptrie)
 {
     FILE *fd;
     char *buffer = reader_init();
-    struct token_s *mytok;
-    int readcount, loopguard = 0;
-    static enum token_type last_type = ENTOK_NONE;
-    static AC_PATTERN_t last_pattern = {{NULL, 0}, {NULL, 0}, {{0}, 0}};
+    int readcount;
+    struct stat file_stat;
+    void *map = MAP_FAILED;
+    int prot = PROT_READ;
     
     if ((fd = fopen(infile, "r")) == NULL)
     {
@@ -61,100 +139,677 @@ int pattern_load (const char *infile, AC_TRIE_t **ptrie)
         return -1;
     }
 
-    /* Initialize string memory */
-    strmm_init (&strmem);
-
     /* Initialize automata */
     trie = ac_trie_create ();
-
-    /* Main loop to read patterns from pattern file */
-    while ((readcount = fread((void*)buffer, 1, READ_BUFFER_SIZE, fd)) > 0)
+    trie->build_threads = config.build_threads;
+    trie->match_mode = config.match_mode;
+    trie->merge_duplicates = config.merge_duplicates;
+    
+    /* A regular pattern file is mapped and scanned as a whole. The simple 
+     * formats change the case of the patterns in their private map */
+    if (config.insensitive && config.pattern_format != PATTERN_FORMAT_AX)
+        prot |= PROT_WRITE;
+    
+    if (!fstat(fileno(fd), &file_stat) && S_ISREG(file_stat.st_mode) && 
+            file_stat.st_size > 0)
+        map = mmap (NULL, file_stat.st_size, prot, MAP_PRIVATE, 
+                fileno(fd), 0);
+    
+    /* Initialize string memory; the decoded strings are not bigger than the 
+     * file, so one block is usually enough */
+    strmm_init (&strmem, (map != MAP_FAILED) ? file_stat.st_size : 0);
+    
+    if (map != MAP_FAILED)
     {
-        reader_reset_buffer (readcount);
-
-        while ((mytok = reader_get_next_token()))
+        pattern_map = map;
+        pattern_map_size = file_stat.st_size;
+    }
+    
+    if (config.pattern_format != PATTERN_FORMAT_AX)
+    {
+        if (map != MAP_FAILED)
+        {
+            madvise (map, file_stat.st_size, MADV_SEQUENTIAL);
+            last_type = pattern_load_simple (fd, (char *) map, 
+                    file_stat.st_size) ? ENTOK_ERR : ENTOK_EOF;
+        }
+        else
+        {
+            last_type = pattern_load_simple (fd, NULL, 0) ? 
+                    ENTOK_ERR : ENTOK_EOF;
+        }
+    }
+    else if (map != MAP_FAILED)
+    {
+        madvise (map, file_stat.st_size, MADV_SEQUENTIAL);
+        
+        if (config.build_threads > 1 && 
+                file_stat.st_size >= PATTERN_SHARD_MIN_SIZE)
+        {
+            pattern_load_sharded ((const char *) map, file_stat.st_size);
+        }
+        else
+        {
+            reader_map ((const char *) map, file_stat.st_size, 0);
+            pattern_read_tokens ();
+        }
+    }
+    else
+    {
+        /* Main loop to read patterns from pattern file */
+        while ((readcount = fread((void*)buffer, 1, READ_BUFFER_SIZE, fd)) > 0)
         {
-            if (mytok->type == ENTOK_EOBUF)
+            reader_reset_buffer (readcount);
+            
+            if (pattern_read_tokens ())
                 break;
+        }
+    }
+
+    if (last_type != ENTOK_EOF)
+    {
+        printf ("Unexpected end of pattern file\n");
+        return -1;
+    }
+    
+    /* The table is not needed by the trie */
+    free (seen);
+    seen = NULL;
+    seen_size = seen_capacity = 0;
+    
+    if (config.sort_patterns)
+        pattern_addbulk ();
+    
+    if (config.merge_duplicates && config.verbosity)
+        printf ("Merged duplicate patterns: %lu\n", 
+                (unsigned long) trie->merged_count);
+    
+    if (duplicates)
+        printf ("WARNINIG: Skipped %lu duplicate patterns\n", 
+                (unsigned long) duplicates);
+    
+    /* Finalize the trie */
+    ac_trie_finalize (trie);
+
+    *ptrie = trie;
+
+    fclose (fd);
+    reader_release();
+
+    return 0;
+}
+
+/******************************************************************************
+ * FUNCTION
+ *****************************************************************************/
+
+int pattern_read_tokens (void)
+{
+    struct token_s *mytok;
+    int loopguard = 0;
+    
+    /* Take the tokens of the current buffer; returns 1 at the end of file or 
+     * on error, 0 if the next buffer is needed */
+    while ((mytok = reader_get_next_token()))
+    {
+        if (mytok->type == ENTOK_EOBUF)
+            break;
 
-            switch (mytok->type)
+        switch (mytok->type)
+        {
+        case ENTOK_AX:
+            if (last_type == ENTOK_PATTERN || 
+                    last_type == ENTOK_REPLACEMENT)
+                pattern_addtoac (&last_pattern);
+            last_pattern.id.u.stringy = NULL;
+            last_pattern.rtext.astring = NULL;
+            last_pattern.rtext.length = 0;
+            break;
+            
+        case ENTOK_ID:
+            if (mytok->length == 0)
+                pattern_genrep(&last_pattern.id.u.stringy);
+            else
+                last_pattern.id.u.stringy = 
+                        strmm_addstrid (&strmem, mytok->value);
+                /* mytok->value is null-terminated */
+            break;
+            
+        case ENTOK_PATTERN:
+            if (last_pattern.id.u.stringy == NULL)
+                pattern_genrep (&last_pattern.id.u.stringy);
+            
+            last_pattern.ptext.length = mytok->length;
+            
+            if (mytok->source && !config.insensitive)
+            {
+                last_pattern.ptext.astring = mytok->source;
+            }
+            else
             {
-            case ENTOK_AX:
-                if (last_type == ENTOK_PATTERN || 
-                        last_type == ENTOK_REPLACEMENT)
-                    pattern_addtoac (&last_pattern);
-                last_pattern.id.u.stringy = NULL;
-                break;
-                
-            case ENTOK_ID:
-                if (mytok->length == 0)
-                    pattern_genrep(&last_pattern.id.u.stringy);
-                else
-                    last_pattern.id.u.stringy = 
-                            strmm_addstrid (&strmem, mytok->value);
-                    /* mytok->value is null-terminated */
-                break;
-                
-            case ENTOK_PATTERN:
-                if (last_pattern.id.u.stringy == NULL)
-                    pattern_genrep (&last_pattern.id.u.stringy);
-                
                 if (config.insensitive)
                     lower_case(mytok->value, mytok->length);
                 
                 last_pattern.ptext.astring = mytok->value;
-                last_pattern.ptext.length = mytok->length;
                 pattern_makeacopy (&last_pattern.ptext.astring, 
                         last_pattern.ptext.length);
-                break;
-                
-            case ENTOK_REPLACEMENT:
+            }
+            break;
+            
+        case ENTOK_REPLACEMENT:
+            last_pattern.rtext.length = mytok->length;
+            
+            if (mytok->source)
+            {
+                last_pattern.rtext.astring = mytok->source;
+            }
+            else
+            {
                 last_pattern.rtext.astring = mytok->value;
-                last_pattern.rtext.length = mytok->length;
                 pattern_makeacopy (&last_pattern.rtext.astring, 
                         last_pattern.rtext.length);
-                break;
-                
-            case ENTOK_ERR:
-                printf ("%s\n", mytok->value);
-                loopguard = 1;
-                break;
-                
-            case ENTOK_EOF:
-                if (last_type == ENTOK_PATTERN || last_type==ENTOK_REPLACEMENT)
-                    pattern_addtoac (&last_pattern);
-                loopguard = 1;
-                break;
-                
-            case ENTOK_NONE:
-            case ENTOK_EOBUF:
-                /* Not expected to come here */
-                /* TODO: Warning */
-                break;
             }
-            last_type = mytok->type;
-            if (loopguard)
-                break;
+            break;
+            
+        case ENTOK_ERR:
+            printf ("%s\n", mytok->value);
+            loopguard = 1;
+            break;
+            
+        case ENTOK_EOF:
+            if (last_type == ENTOK_PATTERN || last_type==ENTOK_REPLACEMENT)
+                pattern_addtoac (&last_pattern);
+            loopguard = 1;
+            break;
+            
+        case ENTOK_NONE:
+        case ENTOK_EOBUF:
+            /* Not expected to come here */
+            /* TODO: Warning */
+            break;
         }
-
+        last_type = mytok->type;
         if (loopguard)
             break;
     }
+    
+    return loopguard;
+}
 
-    if (last_type != ENTOK_EOF)
+/******************************************************************************
+ * FUNCTION
+ *****************************************************************************/
+
+int pattern_load_simple (FILE *fd, char *text, size_t size)
+{
+    size_t capacity = 0, readcount;
+    
+    /* The simple formats are loaded from the whole file; an unmapped file 
+     * is read into the memory and kept like a mapped one */
+    if (text == NULL)
     {
-        printf ("Unexpected end of pattern file\n");
+        do
+        {
+            if (size == capacity)
+            {
+                capacity = capacity ? 2 * capacity : 65536;
+                pattern_whole = (char *) realloc (pattern_whole, capacity);
+            }
+            readcount = fread (pattern_whole + size, 1, capacity - size, fd);
+            size += readcount;
+        } while (readcount > 0);
+        
+        text = pattern_whole;
+    }
+    
+    if (config.pattern_format == PATTERN_FORMAT_BINARY)
+        return pattern_load_binary (text, size);
+    else
+        return pattern_load_lines (text, size);
+}
+
+/******************************************************************************
+ * FUNCTION
+ *****************************************************************************/
+
+static void pattern_add_simple (AC_PATTERN_t *patt, const char *id, 
+        size_t id_length)
+{
+    /* The pattern and the replacement refer to the file; only the ID is 
+     * copied, since it must be null-terminated */
+    if (config.insensitive)
+        lower_case ((char *) patt->ptext.astring, patt->ptext.length);
+    
+    if (id_length)
+    {
+        pattern_makeacopy (&id, id_length);
+        patt->id.u.stringy = id;
+    }
+    else
+    {
+        pattern_genrep (&patt->id.u.stringy);
+    }
+    
+    pattern_addtoac (patt);
+}
+
+/******************************************************************************
+ * FUNCTION
+ *****************************************************************************/
+
+int pattern_load_lines (char *text, size_t size)
+{
+    const char *line, *end, *tab, *id;
+    size_t id_length, lineno = 0, pos = 0;
+    AC_PATTERN_t patt = {{NULL, 0}, {NULL, 0}, {{0}, 0}, NULL};
+    
+    /* Every line is a pattern, optionally followed by a tab and an ID and 
+     * then a tab and a replacement. Empty lines are skipped */
+    while (pos < size)
+    {
+        lineno++;
+        line = &text[pos];
+        
+        if ((end = memchr (line, '\n', size - pos)) == NULL)
+            end = &text[size];
+        pos = (size_t)(end - text) + 1;
+        
+        if (end > line && end[-1] == '\r')
+            end--;
+        if (end == line)
+            continue;
+        
+        id = NULL;
+        id_length = 0;
+        patt.rtext.astring = NULL;
+        patt.rtext.length = 0;
+        patt.ptext.astring = line;
+        
+        if ((tab = memchr (line, '\t', end - line)))
+        {
+            patt.ptext.length = tab - line;
+            id = tab + 1;
+            
+            if ((tab = memchr (id, '\t', end - id)))
+            {
+                patt.rtext.astring = tab + 1;
+                patt.rtext.length = end - tab - 1;
+            }
+            id_length = (tab ? tab : end) - id;
+        }
+        else
+        {
+            patt.ptext.length = end - line;
+        }
+        
+        if (patt.ptext.length >= AC_PATTRN_MAX_LENGTH || 
+                patt.rtext.length >= AC_PATTRN_MAX_LENGTH || 
+                id_length >= AC_PATTRN_MAX_LENGTH)
+        {
+            printf ("[Error at line %lu] Very big pattern/ID\n", 
+                    (unsigned long) lineno);
+            return -1;
+        }
+        
+        pattern_add_simple (&patt, id, id_length);
+    }
+    
+    return 0;
+}
+
+/******************************************************************************
+ * FUNCTION
+ *****************************************************************************/
+
+static int pattern_binary_field (const char *text, size_t size, size_t *pos, 
+        const char **field, size_t *length)
+{
+    const unsigned char *p = (const unsigned char *) &text[*pos];
+    unsigned long value;
+    
+    /* A 32-bit little-endian length and then the bytes of the field */
+    if (size - *pos < 4)
         return -1;
+    
+    value = (unsigned long) p[0] | ((unsigned long) p[1] << 8) | 
+            ((unsigned long) p[2] << 16) | ((unsigned long) p[3] << 24);
+    *pos += 4;
+    
+    if (value == 0xFFFFFFFFUL)
+    {
+        /* Absent field */
+        *field = NULL;
+        *length = 0;
+        return 0;
     }
     
-    /* Finalize the trie */
-    ac_trie_finalize (trie);
+    if (value >= AC_PATTRN_MAX_LENGTH || size - *pos < value)
+        return -1;
+    
+    *field = &text[*pos];
+    *length = value;
+    *pos += value;
+    
+    return 0;
+}
 
-    *ptrie = trie;
+/******************************************************************************
+ * FUNCTION
+ *****************************************************************************/
 
-    fclose (fd);
-    reader_release();
+int pattern_load_binary (char *text, size_t size)
+{
+    const char *id;
+    size_t id_length, record, pos = 0;
+    AC_PATTERN_t patt = {{NULL, 0}, {NULL, 0}, {{0}, 0}, NULL};
+    
+    /* Every record has three length-prefixed fields: the pattern, the ID and 
+     * the replacement. An empty ID is generated automatically */
+    while (pos < size)
+    {
+        record = pos;
+        
+        if (pattern_binary_field (text, size, &pos, 
+                    &patt.ptext.astring, &patt.ptext.length) || 
+                patt.ptext.astring == NULL || 
+                pattern_binary_field (text, size, &pos, &id, &id_length) || 
+                pattern_binary_field (text, size, &pos, 
+                    &patt.rtext.astring, &patt.rtext.length))
+        {
+            printf ("[Error at byte %lu] Bad or very big record\n", 
+                    (unsigned long) record);
+            return -1;
+        }
+        
+        pattern_add_simple (&patt, id, id_length);
+    }
+    
+    return 0;
+}
+
+/******************************************************************************
+ * FUNCTION
+ *****************************************************************************/
+
+static size_t pattern_shard_cut (const char *text, size_t size, size_t pos)
+{
+    const char *nl;
+    
+    /* Find the first line after @pos which looks like the beginning of a 
+     * pattern. It is only a guess; the previous shard checks it */
+    while (pos < size && (nl = memchr (&text[pos], '\n', size - pos)))
+    {
+        pos = (size_t)(nl - text) + 1;
+        
+        if (pos + 1 < size && (text[pos] == 'a' || text[pos] == 'x') && 
+                (text[pos+1] == ' ' || text[pos+1] == '\t' || 
+                 text[pos+1] == '(' || text[pos+1] == '{'))
+            return pos;
+    }
+    
+    return size;
+}
+
+/******************************************************************************
+ * FUNCTION
+ *****************************************************************************/
+
+static void pattern_shard_copy (struct pattern_shard_s *shard, 
+        const AC_ALPHABET_t **astrp, size_t len)
+{
+    if (!strmm_add (&shard->strmem, astrp, len))
+    {
+        printf("Fatal: Copy Failed\n");
+        exit(1);
+    }
+}
+
+/******************************************************************************
+ * FUNCTION
+ *****************************************************************************/
+
+static void pattern_shard_add 
+    (struct pattern_shard_s *shard, struct shard_pattern_s *sp)
+{
+    if (shard->patts_size == shard->patts_capacity)
+    {
+        shard->patts_capacity = shard->patts_capacity ? 
+                2 * shard->patts_capacity : 1024;
+        shard->patts = (struct shard_pattern_s *) realloc (shard->patts, 
+                shard->patts_capacity * sizeof(struct shard_pattern_s));
+    }
+    shard->patts[shard->patts_size++] = *sp;
+}
+
+/******************************************************************************
+ * FUNCTION
+ *****************************************************************************/
+
+static void *pattern_shard_parse (void *arg)
+{
+    struct pattern_shard_s *shard = (struct pattern_shard_s *) arg;
+    struct mapped_reader_s *mp;
+    struct token_s *mytok;
+    struct shard_pattern_s current = 
+            {{{NULL, 0}, {NULL, 0}, {{0}, 0}, NULL}, 0};
+    enum token_type last_type = ENTOK_NONE;
+    
+    mp = reader_open_mapped (shard->text, shard->size, shard->begin);
+    
+    /* The same as pattern_read_tokens(), but the patterns are kept in the 
+     * shard and the automatic identifiers are only counted */
+    while (1)
+    {
+        mytok = reader_get_mapped_token (mp);
+        
+        switch (mytok->type)
+        {
+        case ENTOK_AX:
+            if (last_type == ENTOK_PATTERN || 
+                    last_type == ENTOK_REPLACEMENT)
+                pattern_shard_add (shard, &current);
+            
+            if (reader_mapped_position (mp) - 1 >= shard->end)
+            {
+                /* The pattern belongs to the next shard */
+                shard->next_begin = reader_mapped_position (mp) - 1;
+                shard->last_type = ENTOK_AX;
+                reader_close_mapped (mp);
+                return NULL;
+            }
+            current.patt.id.u.stringy = NULL;
+            current.patt.rtext.astring = NULL;
+            current.patt.rtext.length = 0;
+            current.autoid = 0;
+            break;
+            
+        case ENTOK_ID:
+            if (mytok->length == 0)
+                current.autoid = ++shard->autoids;
+            else
+                current.patt.id.u.stringy = 
+                        strmm_addstrid (&shard->strmem, mytok->value);
+            break;
+            
+        case ENTOK_PATTERN:
+            if (current.patt.id.u.stringy == NULL && current.autoid == 0)
+                current.autoid = ++shard->autoids;
+            
+            current.patt.ptext.length = mytok->length;
+            
+            if (mytok->source && !config.insensitive)
+            {
+                current.patt.ptext.astring = mytok->source;
+            }
+            else
+            {
+                if (config.insensitive)
+                    lower_case(mytok->value, mytok->length);
+                
+                current.patt.ptext.astring = mytok->value;
+                pattern_shard_copy (shard, &current.patt.ptext.astring, 
+                        current.patt.ptext.length);
+            }
+            break;
+            
+        case ENTOK_REPLACEMENT:
+            current.patt.rtext.length = mytok->length;
+            
+            if (mytok->source)
+            {
+                current.patt.rtext.astring = mytok->source;
+            }
+            else
+            {
+                current.patt.rtext.astring = mytok->value;
+                pattern_shard_copy (shard, &current.patt.rtext.astring, 
+                        current.patt.rtext.length);
+            }
+            break;
+            
+        case ENTOK_ERR:
+            shard->errmsg = strdup (mytok->value);
+            /* fall through */
+        case ENTOK_EOF:
+            if (mytok->type == ENTOK_EOF && (last_type == ENTOK_PATTERN || 
+                    last_type == ENTOK_REPLACEMENT))
+                pattern_shard_add (shard, &current);
+            shard->next_begin = shard->size;
+            shard->last_type = mytok->type;
+            reader_close_mapped (mp);
+            return NULL;
+            
+        default:
+            break;
+        }
+        last_type = mytok->type;
+    }
+}
+
+/******************************************************************************
+ * FUNCTION
+ *****************************************************************************/
 
+int pattern_load_sharded (const char *text, size_t size)
+{
+    pthread_t *threads;
+    struct pattern_shard_s *shard;
+    size_t i, j, count, expected = 0;
+    int genrep_base;
+    AC_PATTERN_t *patt;
+    
+    /* Every shard gets at least PATTERN_SHARD_MIN_SIZE bytes */
+    count = config.build_threads;
+    if (count > MF_MAX_THREADS)
+        count = MF_MAX_THREADS;
+    if (count > size / PATTERN_SHARD_MIN_SIZE)
+        count = size / PATTERN_SHARD_MIN_SIZE;
+    
+    shards = NULL;
+    threads = NULL;
+    
+    if (count > 1)
+    {
+        shards = (struct pattern_shard_s *) 
+                calloc (count, sizeof(struct pattern_shard_s));
+        threads = (pthread_t *) malloc (count * sizeof(pthread_t));
+    }
+    
+    if (!shards || !threads)
+    {
+        /* Read the file sequentially */
+        free (shards);
+        free (threads);
+        shards = NULL;
+        reader_map (text, size, 0);
+        pattern_read_tokens ();
+        return 0;
+    }
+    
+    /* Split the file at the guessed pattern beginnings and parse the parts 
+     * in parallel */
+    for (i = 0; i < count; i++)
+    {
+        shard = &shards[i];
+        shard->text = text;
+        shard->size = size;
+        shard->begin = i ? shards[i-1].end : 0;
+        shard->end = (i == count - 1) ? size : 
+                pattern_shard_cut (text, size, size / count * (i + 1));
+        if (shard->end < shard->begin)
+            shard->end = shard->begin;
+        strmm_init (&shard->strmem, shard->end - shard->begin);
+        
+        shard->threaded = 1;
+        if (pthread_create (&threads[i], NULL, pattern_shard_parse, shard))
+        {
+            shard->threaded = 0;
+            pattern_shard_parse (shard); /* Parse it here */
+        }
+    }
+    
+    for (i = 0; i < count; i++)
+        if (shards[i].threaded)
+            pthread_join (threads[i], NULL);
+    
+    free (threads);
+    
+    /* Add the patterns in the order of the file. A shard is valid if the 
+     * previous shard stopped where it begins */
+    for (i = 0; i < count && last_type != ENTOK_EOF; i++)
+    {
+        shard = &shards[i];
+        
+        if (shard->begin != expected)
+            break;
+        
+        genrep_base = genrep_item;
+        
+        for (j = 0; j < shard->patts_size; j++)
+        {
+            patt = &shard->patts[j].patt;
+            
+            if (shard->patts[j].autoid)
+            {
+                genrep_item = genrep_base + shard->patts[j].autoid - 1;
+                pattern_genrep (&patt->id.u.stringy);
+            }
+            pattern_addtoac (patt);
+        }
+        genrep_item = genrep_base + shard->autoids;
+        
+        if (shard->last_type == ENTOK_ERR)
+        {
+            printf ("%s\n", shard->errmsg);
+            last_type = ENTOK_ERR;
+            i++;
+            break;
+        }
+        
+        last_type = shard->last_type;
+        expected = shard->next_begin;
+    }
+    
+    shards_count = i;
+    
+    /* The rest of the shards are released; their strings are not used */
+    for (; i < count; i++)
+        strmm_release (&shards[i].strmem);
+    
+    for (i = 0; i < count; i++)
+    {
+        free (shards[i].patts);
+        free (shards[i].errmsg);
+    }
+    
+    /* A guess was wrong; the rest is read sequentially */
+    if (last_type == ENTOK_AX)
+    {
+        last_type = ENTOK_NONE;
+        reader_map (text, size, expected);
+        pattern_read_tokens ();
+    }
+    
     return 0;
 }
 
@@ -178,16 +833,165 @@ void pattern_makeacopy (const AC_ALPHABET_t **astrp, size_t len)
 
 int pattern_addtoac (AC_PATTERN_t *patt)
 {
+    /* The merged duplicates are told apart by their IDs */
+    patt->id.type = AC_PATTID_TYPE_STRING;
+    
+    if (pattern_isduplicate (patt))
+    {
+        pattern_report (patt, ACERR_DUPLICATE_PATTERN);
+        return 0;
+    }
+    
+    if (config.sort_patterns)
+    {
+        /* Collect the pattern to be added in bulk */
+        if (bulk_size == bulk_capacity)
+        {
+            bulk_capacity = bulk_capacity ? 2 * bulk_capacity : 1024;
+            bulk_patts = (AC_PATTERN_t *) realloc 
+                    (bulk_patts, bulk_capacity * sizeof(AC_PATTERN_t));
+        }
+        bulk_patts[bulk_size++] = *patt;
+        return 0;
+    }
+    
     /* Add pattern to automata */
-    switch (ac_trie_add (trie, patt, 0))
+    pattern_report (patt, ac_trie_add (trie, patt, 0));
+
+    return 0;
+}
+
+/******************************************************************************
+ * FUNCTION
+ *****************************************************************************/
+
+static size_t pattern_hash (const AC_ALPHABET_t *str, size_t length)
+{
+    /* FNV-1a */
+    size_t i, hash = 2166136261U;
+    
+    for (i = 0; i < length; i++)
+        hash = (hash ^ (unsigned char) str[i]) * 16777619U;
+    
+    return hash ^ (hash >> 16);
+}
+
+/******************************************************************************
+ * FUNCTION
+ *****************************************************************************/
+
+static size_t pattern_seen_hash (const AC_TEXT_t *ptext, const char *id)
+{
+    size_t hash = pattern_hash (ptext->astring, ptext->length);
+    
+    if (config.merge_duplicates && id)
+        hash = (hash * 16777619U) ^ pattern_hash (id, strlen (id));
+    
+    return hash;
+}
+
+/******************************************************************************
+ * FUNCTION
+ *****************************************************************************/
+
+int pattern_isduplicate (AC_PATTERN_t *patt)
+{
+    struct seen_pattern_s *old_seen, *entry;
+    size_t i, j, old_capacity;
+    size_t length = patt->ptext.length;
+    const char *id = patt->id.u.stringy;
+    
+    /* The trie rejects these strings itself */
+    if (!length || length > AC_PATTRN_MAX_LENGTH)
+        return 0;
+    
+    /* Grow the open addressing table, keeping it at most half full */
+    if (2 * (seen_size + 1) > seen_capacity)
+    {
+        old_seen = seen;
+        old_capacity = seen_capacity;
+        seen_capacity = old_capacity ? 2 * old_capacity : 1024;
+        seen = (struct seen_pattern_s *) 
+                calloc (seen_capacity, sizeof(struct seen_pattern_s));
+        
+        for (i = 0; i < old_capacity; i++)
+        {
+            if (!old_seen[i].ptext.length)
+                continue;
+            
+            for (j = pattern_seen_hash (&old_seen[i].ptext, old_seen[i].id) &
+                    (seen_capacity - 1); seen[j].ptext.length; 
+                    j = (j + 1) & (seen_capacity - 1))
+                ;
+            seen[j] = old_seen[i];
+        }
+        free (old_seen);
+    }
+    
+    for (i = pattern_seen_hash (&patt->ptext, id) & (seen_capacity - 1);
+            ; i = (i + 1) & (seen_capacity - 1))
+    {
+        entry = &seen[i];
+        
+        if (!entry->ptext.length)
+            break;
+        
+        if (entry->ptext.length == length && !memcmp (entry->ptext.astring, 
+                patt->ptext.astring, length * sizeof(AC_ALPHABET_t)) && 
+                (!config.merge_duplicates || entry->id == id || 
+                (entry->id && id && !strcmp (entry->id, id))))
+            return 1;
+    }
+    
+    entry->ptext = patt->ptext;
+    entry->id = id;
+    seen_size++;
+    
+    return 0;
+}
+
+/******************************************************************************
+ * FUNCTION
+ *****************************************************************************/
+
+void pattern_addbulk (void)
+{
+    size_t i;
+    AC_STATUS_t *status = (AC_STATUS_t *) 
+            malloc (bulk_size * sizeof(AC_STATUS_t));
+    
+    ac_trie_add_bulk (trie, bulk_patts, bulk_size, 0, status);
+    
+    for (i = 0; i < bulk_size; i++)
+        pattern_report (&bulk_patts[i], status[i]);
+    
+    free (status);
+    
+    /* The trie keeps its own copy of the pattern structures */
+    free (bulk_patts);
+    bulk_patts = NULL;
+    bulk_size = bulk_capacity = 0;
+}
+
+/******************************************************************************
+ * FUNCTION
+ *****************************************************************************/
+
+void pattern_report (AC_PATTERN_t *patt, AC_STATUS_t status)
+{
+    switch (status)
     {
         case ACERR_DUPLICATE_PATTERN:
-            printf("WARNINIG: Skip duplicate string: %s\n", 
-                    patt->ptext.astring);
+            /* Only the number of duplicates is reported at the end */
+            duplicates++;
+            if (config.verbosity)
+                printf("WARNINIG: Skip duplicate string: %.*s\n", 
+                        (int) patt->ptext.length, patt->ptext.astring);
             break;
             
         case ACERR_LONG_PATTERN:
-            printf("WARNINIG: Skip long string: %s\n", patt->ptext.astring);
+            printf("WARNINIG: Skip long string: %.*s\n", 
+                    (int) patt->ptext.length, patt->ptext.astring);
             break;
             
         case ACERR_ZERO_PATTERN:
@@ -207,8 +1011,6 @@ int pattern_addtoac (AC_PATTERN_t *patt)
             printf("WARNINIG: Skip adding string.\n");
             break;
     }
-
-    return 0;
 }
 
 /******************************************************************************
@@ -217,8 +1019,22 @@ int pattern_addtoac (AC_PATTERN_t *patt)
 
 void pattern_release ()
 {
+    size_t i;
+    
     /* Release string memory */
     strmm_release (&strmem);
+    
+    if (pattern_map != MAP_FAILED)
+        munmap (pattern_map, pattern_map_size);
+    pattern_map = MAP_FAILED;
+    free (pattern_whole);
+    pattern_whole = NULL;
+    
+    for (i = 0; i < shards_count; i++)
+        strmm_release (&shards[i].strmem);
+    free (shards);
+    shards = NULL;
+    shards_count = 0;
 }
 
 /******************************************************************************
@@ -264,7 +1080,6 @@ void pattern_genrep (const char **id)
 {
     /* Get automatic representative for none-representative patterns. */
     static char strid[64];
-    static int item = 1;
-    sprintf(strid, "p%06d", item++);
+    sprintf(strid, "p%06d", genrep_item++);
     *id = strmm_addstrid(&strmem, strid);
 }
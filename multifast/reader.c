@@ -20,6 +20,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "reader.h"
 #include "ahocorasick.h"
 
@@ -65,8 +66,19 @@ struct buffer_s
     char * pool;
 };
 
+/* A pattern file which is mapped to the memory as a whole; every reader 
+ * has its own parser, so several parts of a file can be read at once */
+struct mapped_reader_s
+{
+    struct parser_s parser;
+    const char *text;
+    size_t size;
+    size_t index;
+};
+
 static struct parser_s parser;
 static struct buffer_s buffer;
+static struct mapped_reader_s *mapped;
 
 #define IZSPACE(x) (x==' '||x=='\t'||x=='\n'||x=='\r')
 
@@ -103,11 +115,14 @@ char *reader_init(void)
     parser.token.length = 0;
     parser.token.type = ENTOK_NONE;
     parser.token.value[0] = 0;
+    parser.token.source = NULL;
 
     buffer.pool = (char *) malloc (READ_BUFFER_SIZE);
     buffer.index = 0;
     buffer.max_index = 0;
     buffer.pool[0] = 0;
+    
+    mapped = NULL;
 
     return buffer.pool;
 }
@@ -122,6 +137,66 @@ void reader_reset_buffer(int max)
     buffer.max_index = max;
 }
 
+/******************************************************************************
+ * FUNCTION:
+ *****************************************************************************/
+
+void reader_map (const char *text, size_t size, size_t begin)
+{
+    /* The whole file is given at once; no EOBUF token is returned */
+    mapped = reader_open_mapped (text, size, begin);
+}
+
+/******************************************************************************
+ * FUNCTION:
+ *****************************************************************************/
+
+struct mapped_reader_s *reader_open_mapped 
+    (const char *text, size_t size, size_t begin)
+{
+    struct mapped_reader_s *mp = (struct mapped_reader_s *) 
+            malloc (sizeof(struct mapped_reader_s));
+    
+    /* The reading starts at @begin; it must be the beginning of a pattern 
+     * or a comment. The whole text is kept for the error line numbers */
+    mp->parser.state = 0;
+    mp->parser.lineno = 1;
+    mp->parser.colno = 0;
+    mp->parser.xhalfpos = XHALF_H;
+    mp->parser.parsmod = PARSMOD_UNK;
+    mp->parser.escmod = ESCMOD_OFF;
+    mp->parser.token.value = (char *) malloc (AC_PATTRN_MAX_LENGTH);
+    mp->parser.token.length = 0;
+    mp->parser.token.type = ENTOK_NONE;
+    mp->parser.token.value[0] = 0;
+    mp->parser.token.source = NULL;
+    
+    mp->text = text;
+    mp->size = size;
+    mp->index = begin;
+    
+    return mp;
+}
+
+/******************************************************************************
+ * FUNCTION:
+ *****************************************************************************/
+
+size_t reader_mapped_position (struct mapped_reader_s *mp)
+{
+    return mp->index;
+}
+
+/******************************************************************************
+ * FUNCTION:
+ *****************************************************************************/
+
+void reader_close_mapped (struct mapped_reader_s *mp)
+{
+    free (mp->parser.token.value);
+    free (mp);
+}
+
 /******************************************************************************
  * FUNCTION:
  *****************************************************************************/
@@ -199,6 +274,9 @@ int scan_pattern (char ch)
 struct token_s *reader_get_next_token(void)
 {
     char ch;
+    
+    if (mapped)
+        return reader_get_mapped_token (mapped);
 
     if (parser.token.type != ENTOK_EOBUF)
     {
@@ -364,6 +442,292 @@ void reader_release (void)
 {
     free(parser.token.value);
     free(buffer.pool);
+    
+    if (mapped)
+        reader_close_mapped (mapped);
+    mapped = NULL;
+}
+
+/******************************************************************************
+ * FUNCTION:
+ *****************************************************************************/
+
+static int reader_mapped_error 
+    (struct mapped_reader_s *mp, const char *msg, size_t pos)
+{
+    const char *text = mp->text, *nl;
+    size_t lineno = 1, line_start = 0;
+    
+    /* The position is converted to line and column only when it is reported;
+     * the column is counted like the character reader does */
+    while ((nl = memchr (&text[line_start], '\n', pos + 1 - line_start)))
+    {
+        lineno++;
+        line_start = (size_t)(nl - text) + 1;
+    }
+    
+    /* Like the character reader, the error token is returned when the next 
+     * character is read */
+    mp->parser.state = 9;
+    snprintf (mp->parser.token.value, AC_PATTRN_MAX_LENGTH, "[Error at %lu:%lu] %s",
+            (unsigned long) lineno, (unsigned long) (pos + 1 - line_start), 
+            msg);
+    
+    return -1;
+}
+
+/******************************************************************************
+ * FUNCTION:
+ *****************************************************************************/
+
+static int reader_scan_mapped_ascii (struct mapped_reader_s *mp)
+{
+    const char *text = mp->text;
+    const char *start, *stop;
+    const char *body = &text[mp->index];
+    size_t range, count;
+    int escaped = 0;
+    
+    while (mp->index < mp->size)
+    {
+        /* A body longer than AC_PATTRN_MAX_LENGTH is an error, so only that 
+         * much is searched for the closing bracket and the escapes */
+        start = &text[mp->index];
+        range = mp->size - mp->index;
+        if (range > AC_PATTRN_MAX_LENGTH - mp->parser.token.length + 1)
+            range = AC_PATTRN_MAX_LENGTH - mp->parser.token.length + 1;
+        
+        if ((stop = memchr (start, '}', range)))
+            range = stop - start;
+        if ((stop = memchr (start, '\\', range)))
+            range = stop - start;
+        count = range;
+        
+        if (mp->parser.token.length + count > AC_PATTRN_MAX_LENGTH)
+            count = AC_PATTRN_MAX_LENGTH - mp->parser.token.length;
+        
+        /* Copy the plain characters at once */
+        memcpy (&mp->parser.token.value[mp->parser.token.length], start, count);
+        mp->parser.token.length += count;
+        mp->index += count;
+        
+        if (mp->parser.token.length == AC_PATTRN_MAX_LENGTH && 
+                mp->index < mp->size)
+            return reader_mapped_error (mp, "Very big pattern/ID", mp->index);
+        
+        if (mp->index == mp->size)
+            break;
+        
+        if (text[mp->index++] == '}')
+        {
+            /* The file itself holds the value */
+            if (!escaped)
+                mp->parser.token.source = body;
+            return 0;
+        }
+        
+        /* The character after the backslash is taken as is */
+        escaped = 1;
+        if (mp->index == mp->size)
+            break;
+        
+        mp->parser.token.value[mp->parser.token.length++] = text[mp->index++];
+    }
+    
+    return 1;
+}
+
+/******************************************************************************
+ * FUNCTION:
+ *****************************************************************************/
+
+static int reader_scan_mapped_hex (struct mapped_reader_s *mp)
+{
+    const char *text = mp->text;
+    char ch;
+    
+    while (mp->index < mp->size)
+    {
+        ch = text[mp->index];
+        
+        if (mp->parser.token.length >= AC_PATTRN_MAX_LENGTH)
+            return reader_mapped_error (mp, "Very big pattern/ID", mp->index);
+        
+        if (IZHEXCHAR(ch))
+        {
+            if (mp->parser.xhalfpos == XHALF_H)
+            {
+                GETHEXVALUE(ch, mp->parser.xhigh)
+                mp->parser.xhigh <<= 4;
+                mp->parser.xhalfpos = XHALF_L;
+            }
+            else
+            {
+                GETHEXVALUE(ch, mp->parser.xlow)
+                mp->parser.token.value[mp->parser.token.length++] = 
+                        (char)(mp->parser.xhigh|mp->parser.xlow);
+                mp->parser.xhalfpos = XHALF_H;
+            }
+        }
+        else if (ch == '}')
+        {
+            if (mp->parser.xhalfpos == XHALF_L)
+                return reader_mapped_error 
+                        (mp, "Odd number of hex digits", mp->index++);
+            
+            mp->index++;
+            return 0;
+        }
+        else if (!IZSPACE(ch))
+        {
+            return reader_mapped_error 
+                    (mp, "Unexpected Character in Hex", mp->index++);
+        }
+        
+        mp->index++;
+    }
+    
+    return 1;
+}
+
+/******************************************************************************
+ * FUNCTION:
+ *****************************************************************************/
+
+struct token_s *reader_get_mapped_token (struct mapped_reader_s *mp)
+{
+    const char *text = mp->text, *nl;
+    char ch;
+    int ret;
+    
+    mp->parser.token.type = ENTOK_NONE;
+    mp->parser.token.length = 0;
+    mp->parser.token.value[0] = '\0';
+    mp->parser.token.source = NULL;
+    
+    /* It follows the states of reader_get_next_token(), but the comments, 
+     * the IDs and the pattern bodies are scanned in bulk */
+    while (mp->index < mp->size)
+    {
+        ch = text[mp->index];
+        
+        switch (mp->parser.state)
+        {
+        case 0:
+        case 6:
+            if (ch == '#' && mp->parser.state == 0)
+            {
+                nl = memchr (&text[mp->index], '\n', 
+                        mp->size - mp->index);
+                mp->index = nl ? (size_t)(nl - text) + 1 : mp->size;
+                continue;
+            }
+            else if (ch == '>' && mp->parser.state == 6)
+            {
+                mp->parser.state = 7;
+            }
+            else if (ch == 'a' || ch == 'x')
+            {
+                mp->index++;
+                mp->parser.state = 2;
+                mp->parser.token.type = ENTOK_AX;
+                mp->parser.token.value[mp->parser.token.length++] = ch;
+                mp->parser.token.value[mp->parser.token.length] = '\0';
+                mp->parser.parsmod = (ch == 'a') ? PARSMOD_ASC : PARSMOD_HEX;
+                return &mp->parser.token;
+            }
+            else if (!IZSPACE(ch))
+            {
+                reader_mapped_error (mp, "Expected 'a' or 'x'", mp->index);
+            }
+            break;
+            
+        case 2:
+            if (ch == '(')
+            {
+                mp->parser.state = 3;
+            }
+            else if (ch == '{')
+            {
+                mp->parser.state = 5;
+                mp->parser.xhalfpos = XHALF_H;
+            }
+            else if (!IZSPACE(ch))
+            {
+                reader_mapped_error (mp, "Expected '(' or '{'", mp->index);
+            }
+            break;
+            
+        case 3:
+            while (IZIDCHAR(ch) && mp->parser.token.length < AC_PATTRN_MAX_LENGTH)
+            {
+                mp->parser.token.value[mp->parser.token.length++] = ch;
+                if (++mp->index == mp->size)
+                    break;
+                ch = text[mp->index];
+            }
+            
+            if (mp->index == mp->size)
+                continue;
+            
+            if (mp->parser.token.length >= AC_PATTRN_MAX_LENGTH)
+            {
+                reader_mapped_error (mp, "Very big pattern/ID", mp->index);
+            }
+            else if (ch == ')')
+            {
+                mp->index++;
+                mp->parser.state = 4;
+                mp->parser.token.type = ENTOK_ID;
+                mp->parser.token.value[mp->parser.token.length] = '\0';
+                return &mp->parser.token;
+            }
+            else
+            {
+                reader_mapped_error (mp, "Invalid character in ID", mp->index++);
+            }
+            continue;
+            
+        case 4:
+        case 7:
+            if (ch == '{')
+            {
+                mp->parser.state = (mp->parser.state == 4) ? 5 : 8;
+                mp->parser.xhalfpos = XHALF_H;
+            }
+            else if (!IZSPACE(ch))
+            {
+                reader_mapped_error (mp, "Expected '{'", mp->index);
+            }
+            break;
+            
+        case 5:
+        case 8:
+            if (mp->parser.parsmod == PARSMOD_HEX)
+                ret = reader_scan_mapped_hex (mp);
+            else
+                ret = reader_scan_mapped_ascii (mp);
+            
+            if (ret == 0)
+            {
+                mp->parser.token.type = (mp->parser.state == 5) ? 
+                        ENTOK_PATTERN : ENTOK_REPLACEMENT;
+                mp->parser.state = (mp->parser.state == 5) ? 6 : 0;
+                return &mp->parser.token;
+            }
+            continue;
+            
+        case 9:
+            mp->parser.token.type = ENTOK_ERR;
+            return &mp->parser.token;
+        }
+        
+        mp->index++;
+    }
+    
+    mp->parser.token.type = ENTOK_EOF;
+    
+    return &mp->parser.token;
 }
 
 /*****************************************************************************
@@ -39,13 +39,24 @@ struct token_s
     enum token_type type;
     char *value;
     size_t length;
+    const char *source; /* The value as it is in the mapped file, if it has 
+                         * no escape or hex; otherwise NULL */
 };
 
+struct mapped_reader_s;
+
 char *reader_init (void);
 void reader_reset_buffer (int max); 
+void reader_map (const char *text, size_t size, size_t begin);
 struct token_s *reader_get_next_token (void);
 void reader_release (void);
 
+struct mapped_reader_s *reader_open_mapped 
+    (const char *text, size_t size, size_t begin);
+struct token_s *reader_get_mapped_token (struct mapped_reader_s *mp);
+size_t reader_mapped_position (struct mapped_reader_s *mp);
+void reader_close_mapped (struct mapped_reader_s *mp);
+
 #define READ_BUFFER_SIZE 4096
 
 #endif /* READER_H_ */
@@ -23,61 +23,52 @@
 
 #include "strmm.h"
 
-/* Must be bigger than AC_PATTRN_MAX_LENGTH */
-#define STRING_TABLE_ALLOC_SIZE       4096
-#define STRING_TABLE_MAX_CHUNK_NUMBER 40
-
-#if (AC_PATTRN_MAX_LENGTH>=STRING_TABLE_ALLOC_SIZE)
-#error "STRING_TABLE_ALLOC_SIZE must be bigger than AC_PATTRN_MAX_LENGTH"
-#endif
+/* The smallest block; the next blocks are twice as big as the previous */
+#define STRMM_MIN_BLOCK_SIZE 4096
 
 /******************************************************************************
  * FUNCTION:
  *****************************************************************************/
 
-void strmm_init (STRMM_t *st)
+void strmm_init (STRMM_t *st, size_t size)
 {
-    st->last_chunk = 0;
-    st->max_chunk = STRING_TABLE_MAX_CHUNK_NUMBER;
-    st->space = (AC_ALPHABET_t **) malloc 
-            (st->max_chunk * sizeof(AC_ALPHABET_t *));
-    st->space[st->last_chunk] = (AC_ALPHABET_t *) malloc 
-            (STRING_TABLE_ALLOC_SIZE * sizeof(AC_ALPHABET_t));
-    st->last_pos = 0;
+    /* The first block is as big as the expected total size of the strings, 
+     * so usually no other block is needed */
+    st->block = NULL;
+    st->block_size = (size > STRMM_MIN_BLOCK_SIZE) ? 
+            size : STRMM_MIN_BLOCK_SIZE;
 }
 
 /******************************************************************************
  * FUNCTION:
  *****************************************************************************/
 
-AC_ALPHABET_t *strmm_add (STRMM_t *st, const AC_ALPHABET_t **str, size_t len)
+static AC_ALPHABET_t *strmm_alloc (STRMM_t *st, size_t len)
 {
+    struct strmm_block *block = st->block;
     AC_ALPHABET_t *free_pos;
     
-    if (st->last_pos + len + 1 > STRING_TABLE_ALLOC_SIZE)
+    if (block == NULL || block->size - block->used < len)
     {
-        if(len + 1 > STRING_TABLE_ALLOC_SIZE)
-            return NULL; /* Fatal Error */
+        if (st->block_size < len)
+            st->block_size = len;
+        
+        block = (struct strmm_block *) malloc 
+                (sizeof(struct strmm_block) + st->block_size);
+        if (block == NULL)
+            return NULL;
+        
+        block->next = st->block;
+        block->size = st->block_size;
+        block->used = 0;
         
-        st->last_chunk++;
-        if (st->last_chunk >= st->max_chunk)
-        {
-            st->max_chunk += STRING_TABLE_MAX_CHUNK_NUMBER;
-            st->space = (AC_ALPHABET_t **) realloc 
-                    (st->space, st->max_chunk * sizeof(AC_ALPHABET_t *));
-        }
-        st->space[st->last_chunk] = (AC_ALPHABET_t *) malloc 
-                (STRING_TABLE_ALLOC_SIZE * sizeof(AC_ALPHABET_t));
-        st->last_pos = 0;
+        st->block = block;
+        st->block_size *= 2;
     }
     
-    free_pos = &((st->space[st->last_chunk])[st->last_pos]);
-    memcpy (free_pos, *str, len * sizeof(AC_ALPHABET_t));
-    
-    st->last_pos += len;
-    (st->space[st->last_chunk])[st->last_pos++] = (AC_ALPHABET_t)0;
+    free_pos = (AC_ALPHABET_t *)(block + 1) + block->used;
+    block->used += len;
     
-    *str = free_pos;
     return free_pos;
 }
 
@@ -85,45 +76,42 @@ AC_ALPHABET_t *strmm_add (STRMM_t *st, const AC_ALPHABET_t **str, size_t len)
  * FUNCTION:
  *****************************************************************************/
 
-char * strmm_addstrid (STRMM_t *st, char *str)
+AC_ALPHABET_t *strmm_add (STRMM_t *st, const AC_ALPHABET_t **str, size_t len)
 {
-    char *free_pos;
-    size_t str_length = strlen(str);
+    AC_ALPHABET_t *free_pos;
     
-    if (st->last_pos + str_length + 1 > STRING_TABLE_ALLOC_SIZE)
-    {
-        if (str_length + 1 > STRING_TABLE_ALLOC_SIZE)
-            return NULL; /* Fatal Error */
-        
-        st->last_chunk++;
-        if (st->last_chunk >= st->max_chunk)
-        {
-            st->max_chunk += STRING_TABLE_MAX_CHUNK_NUMBER;
-            st->space = (char **) realloc 
-                    (st->space, st->max_chunk * sizeof(char *));
-        }
-        st->space[st->last_chunk] = (char *) malloc 
-                (STRING_TABLE_ALLOC_SIZE * sizeof(char));
-        st->last_pos = 0;
-    }
+    if ((free_pos = strmm_alloc (st, len + 1)) == NULL)
+        return NULL; /* Fatal Error */
     
-    free_pos = &((st->space[st->last_chunk])[st->last_pos]);
-    memcpy (free_pos, str, str_length * sizeof(char));
-    st->last_pos += str_length;
-    (st->space[st->last_chunk])[st->last_pos++] = (char)0;
+    memcpy (free_pos, *str, len * sizeof(AC_ALPHABET_t));
+    free_pos[len] = (AC_ALPHABET_t)0;
     
+    *str = free_pos;
     return free_pos;
 }
 
+/******************************************************************************
+ * FUNCTION:
+ *****************************************************************************/
+
+char * strmm_addstrid (STRMM_t *st, char *str)
+{
+    const AC_ALPHABET_t *id = str;
+    
+    return strmm_add (st, &id, strlen(str));
+}
+
 /******************************************************************************
  * FUNCTION:
  *****************************************************************************/
 
 void strmm_release (STRMM_t *st)
 {
-    int i;
-    for (i = 0; i <= st->last_chunk; i++)
-        free (st->space[i]);
+    struct strmm_block *block;
     
-    free (st->space);
+    while ((block = st->block))
+    {
+        st->block = block->next;
+        free (block);
+    }
 }
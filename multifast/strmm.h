@@ -24,15 +24,21 @@
 
 #include "actypes.h"
 
+/* A block of the string memory; the strings follow the header */
+struct strmm_block
+{
+    struct strmm_block *next;   /* The previous block */
+    size_t size;
+    size_t used;
+};
+
 typedef struct
 {
-    AC_ALPHABET_t **space;
-    unsigned int last_chunk;
-    unsigned int max_chunk;
-    size_t last_pos;
+    struct strmm_block *block;  /* The current block */
+    size_t block_size;          /* The size of the next block */
 } STRMM_t;
 
-void strmm_init (STRMM_t *st);
+void strmm_init (STRMM_t *st, size_t size);
 AC_ALPHABET_t *strmm_add (STRMM_t *st, const AC_ALPHABET_t **str, size_t len);
 char *strmm_addstrid (STRMM_t *st, char *str);
 void strmm_release (STRMM_t *st);